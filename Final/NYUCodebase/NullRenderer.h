@@ -0,0 +1,198 @@
+#pragma once
+
+//build with NULL_RENDERER defined to replace every GL call the game makes with a stub that only counts
+//calls, draws and bytes sent to the GPU. used with --headless on machines that have no GPU
+
+#ifdef NULL_RENDERER
+
+struct NullRendererStats {
+	unsigned long long calls;
+	unsigned long long drawCalls;
+	unsigned long long vertices;
+	unsigned long long bytesUploaded;
+};
+
+inline NullRendererStats &nullRendererStats() {
+	static NullRendererStats stats = { 0, 0, 0, 0 };
+	return stats;
+}
+
+inline GLuint nullRendererNextID() {
+	static GLuint nextID = 0;
+	return ++nextID;
+}
+
+inline void nullAttachShader(GLuint, GLuint) { nullRendererStats().calls++; }
+inline void nullBindBuffer(GLenum, GLuint) { nullRendererStats().calls++; }
+inline void nullBindTexture(GLenum, GLuint) { nullRendererStats().calls++; }
+inline void nullBindVertexArray(GLuint) { nullRendererStats().calls++; }
+inline void nullBlendFunc(GLenum, GLenum) { nullRendererStats().calls++; }
+inline void nullBufferData(GLenum, GLsizeiptr size, const void *, GLenum) {
+	nullRendererStats().calls++;
+	nullRendererStats().bytesUploaded += size;
+}
+inline void nullBufferSubData(GLenum, GLintptr, GLsizeiptr size, const void *) {
+	nullRendererStats().calls++;
+	nullRendererStats().bytesUploaded += size;
+}
+inline void nullClear(GLbitfield) { nullRendererStats().calls++; }
+inline void nullClearColor(GLfloat, GLfloat, GLfloat, GLfloat) { nullRendererStats().calls++; }
+inline void nullCompileShader(GLuint) { nullRendererStats().calls++; }
+inline GLuint nullCreateProgram() { nullRendererStats().calls++; return nullRendererNextID(); }
+inline GLuint nullCreateShader(GLenum) { nullRendererStats().calls++; return nullRendererNextID(); }
+inline void nullDeleteBuffers(GLsizei, const GLuint *) { nullRendererStats().calls++; }
+inline void nullDeleteProgram(GLuint) { nullRendererStats().calls++; }
+inline void nullDeleteShader(GLuint) { nullRendererStats().calls++; }
+inline void nullDeleteTextures(GLsizei, const GLuint *) { nullRendererStats().calls++; }
+inline void nullDeleteVertexArrays(GLsizei, const GLuint *) { nullRendererStats().calls++; }
+inline void nullDisableVertexAttribArray(GLuint) { nullRendererStats().calls++; }
+inline void nullDrawArrays(GLenum, GLint, GLsizei count) {
+	nullRendererStats().calls++;
+	nullRendererStats().drawCalls++;
+	nullRendererStats().vertices += count;
+}
+inline void nullDrawArraysInstanced(GLenum, GLint, GLsizei count, GLsizei instanceCount) {
+	nullRendererStats().calls++;
+	nullRendererStats().drawCalls++;
+	nullRendererStats().vertices += (unsigned long long)count * instanceCount;
+}
+inline void nullEnable(GLenum) { nullRendererStats().calls++; }
+inline void nullEnableVertexAttribArray(GLuint) { nullRendererStats().calls++; }
+inline void nullGenBuffers(GLsizei n, GLuint *buffers) {
+	nullRendererStats().calls++;
+	for (GLsizei i = 0; i < n; i++) { buffers[i] = nullRendererNextID(); }
+}
+inline void nullGenTextures(GLsizei n, GLuint *textures) {
+	nullRendererStats().calls++;
+	for (GLsizei i = 0; i < n; i++) { textures[i] = nullRendererNextID(); }
+}
+inline void nullGenVertexArrays(GLsizei n, GLuint *arrays) {
+	nullRendererStats().calls++;
+	for (GLsizei i = 0; i < n; i++) { arrays[i] = nullRendererNextID(); }
+}
+inline GLint nullGetAttribLocation(GLuint, const GLchar *) { nullRendererStats().calls++; return 0; }
+inline void nullGetIntegerv(GLenum name, GLint *data) {
+	nullRendererStats().calls++;
+	*data = (name == GL_MAX_TEXTURE_SIZE ? 4096 : 0);
+}
+inline void nullGetProgramiv(GLuint, GLenum, GLint *params) { nullRendererStats().calls++; *params = GL_TRUE; }
+inline void nullGetShaderInfoLog(GLuint, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+	nullRendererStats().calls++;
+	if (length != NULL) { *length = 0; }
+	if (bufSize > 0) { infoLog[0] = '\0'; }
+}
+inline void nullGetShaderiv(GLuint, GLenum, GLint *params) { nullRendererStats().calls++; *params = GL_TRUE; }
+//reports a version new enough for every path the game has, so the null backend counts the fast ones
+inline const GLubyte *nullGetString(GLenum name) {
+	nullRendererStats().calls++;
+	return (const GLubyte*)(name == GL_VERSION ? "3.3 NullRenderer" : "NullRenderer");
+}
+inline GLint nullGetUniformLocation(GLuint, const GLchar *) { nullRendererStats().calls++; return 0; }
+inline void nullLinkProgram(GLuint) { nullRendererStats().calls++; }
+inline void nullShaderSource(GLuint, GLsizei, const GLchar *const *, const GLint *) { nullRendererStats().calls++; }
+inline void nullTexImage2D(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum, GLenum, const void *) {
+	nullRendererStats().calls++;
+	nullRendererStats().bytesUploaded += (unsigned long long)width * height * 4;
+}
+inline void nullTexParameteri(GLenum, GLenum, GLint) { nullRendererStats().calls++; }
+inline void nullUniform4f(GLint, GLfloat, GLfloat, GLfloat, GLfloat) {
+	nullRendererStats().calls++;
+	nullRendererStats().bytesUploaded += 4 * sizeof(GLfloat);
+}
+inline void nullUniformMatrix4fv(GLint, GLsizei count, GLboolean, const GLfloat *) {
+	nullRendererStats().calls++;
+	nullRendererStats().bytesUploaded += count * 16 * sizeof(GLfloat);
+}
+inline void nullUseProgram(GLuint) { nullRendererStats().calls++; }
+inline void nullVertexAttribDivisor(GLuint, GLuint) { nullRendererStats().calls++; }
+inline void nullVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *) { nullRendererStats().calls++; }
+inline void nullViewport(GLint, GLint, GLsizei, GLsizei) { nullRendererStats().calls++; }
+
+//glew defines most of these as macros already
+#undef glAttachShader
+#undef glBindBuffer
+#undef glBindTexture
+#undef glBindVertexArray
+#undef glBlendFunc
+#undef glBufferData
+#undef glBufferSubData
+#undef glClear
+#undef glClearColor
+#undef glCompileShader
+#undef glCreateProgram
+#undef glCreateShader
+#undef glDeleteBuffers
+#undef glDeleteProgram
+#undef glDeleteShader
+#undef glDeleteTextures
+#undef glDeleteVertexArrays
+#undef glDisableVertexAttribArray
+#undef glDrawArrays
+#undef glDrawArraysInstanced
+#undef glEnable
+#undef glEnableVertexAttribArray
+#undef glGenBuffers
+#undef glGenTextures
+#undef glGenVertexArrays
+#undef glGetAttribLocation
+#undef glGetIntegerv
+#undef glGetProgramiv
+#undef glGetShaderInfoLog
+#undef glGetShaderiv
+#undef glGetString
+#undef glGetUniformLocation
+#undef glLinkProgram
+#undef glShaderSource
+#undef glTexImage2D
+#undef glTexParameteri
+#undef glUniform4f
+#undef glUniformMatrix4fv
+#undef glUseProgram
+#undef glVertexAttribDivisor
+#undef glVertexAttribPointer
+#undef glViewport
+
+#define glAttachShader nullAttachShader
+#define glBindBuffer nullBindBuffer
+#define glBindTexture nullBindTexture
+#define glBindVertexArray nullBindVertexArray
+#define glBlendFunc nullBlendFunc
+#define glBufferData nullBufferData
+#define glBufferSubData nullBufferSubData
+#define glClear nullClear
+#define glClearColor nullClearColor
+#define glCompileShader nullCompileShader
+#define glCreateProgram nullCreateProgram
+#define glCreateShader nullCreateShader
+#define glDeleteBuffers nullDeleteBuffers
+#define glDeleteProgram nullDeleteProgram
+#define glDeleteShader nullDeleteShader
+#define glDeleteTextures nullDeleteTextures
+#define glDeleteVertexArrays nullDeleteVertexArrays
+#define glDisableVertexAttribArray nullDisableVertexAttribArray
+#define glDrawArrays nullDrawArrays
+#define glDrawArraysInstanced nullDrawArraysInstanced
+#define glEnable nullEnable
+#define glEnableVertexAttribArray nullEnableVertexAttribArray
+#define glGenBuffers nullGenBuffers
+#define glGenTextures nullGenTextures
+#define glGenVertexArrays nullGenVertexArrays
+#define glGetAttribLocation nullGetAttribLocation
+#define glGetIntegerv nullGetIntegerv
+#define glGetProgramiv nullGetProgramiv
+#define glGetShaderInfoLog nullGetShaderInfoLog
+#define glGetShaderiv nullGetShaderiv
+#define glGetString nullGetString
+#define glGetUniformLocation nullGetUniformLocation
+#define glLinkProgram nullLinkProgram
+#define glShaderSource nullShaderSource
+#define glTexImage2D nullTexImage2D
+#define glTexParameteri nullTexParameteri
+#define glUniform4f nullUniform4f
+#define glUniformMatrix4fv nullUniformMatrix4fv
+#define glUseProgram nullUseProgram
+#define glVertexAttribDivisor nullVertexAttribDivisor
+#define glVertexAttribPointer nullVertexAttribPointer
+#define glViewport nullViewport
+
+#endif
@@ -9,13 +9,26 @@
 #include <fstream>
 #include <sstream>
 #include "glm/mat4x4.hpp"
+#include "NullRenderer.h"
+
+//GL calls ShaderProgram skipped because the program was already bound or the uniform already held that value
+struct ShaderStateStats {
+	unsigned long long useProgramCalls;
+	unsigned long long useProgramSkipped;
+	unsigned long long uniformCalls;
+	unsigned long long uniformSkipped;
+};
 
 class ShaderProgram {
     public:
 	
 		void Load(const char *vertexShaderFile, const char *fragmentShaderFile);
+		bool Reload();
 		void Cleanup();
 
+		//binds this program unless it is already the current one; use instead of calling glUseProgram directly
+		void Bind();
+
 		void SetModelMatrix(const glm::mat4 &matrix);
         void SetProjectionMatrix(const glm::mat4 &matrix);
         void SetViewMatrix(const glm::mat4 &matrix);
@@ -37,4 +50,24 @@ class ShaderProgram {
     
         GLuint vertexShader;
         GLuint fragmentShader;
+
+		std::string vertexShaderPath;
+		std::string fragmentShaderPath;
+
+		static GLuint boundProgram;
+		static ShaderStateStats stats;
+
+	private:
+		bool LinkProgram(GLuint vertexShaderID, GLuint fragmentShaderID, GLuint &linkedProgramID);
+		void GetLocations();
+		void ResetUniformCache();
+
+		glm::mat4 modelMatrix;
+		glm::mat4 projectionMatrix;
+		glm::mat4 viewMatrix;
+		float color[4];
+		bool modelMatrixSet;
+		bool projectionMatrixSet;
+		bool viewMatrixSet;
+		bool colorSet;
 };
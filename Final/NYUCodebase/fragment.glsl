@@ -1,8 +1,8 @@
 
-//uniform vec4 color;
-
-varying vec4 vertexColor
+uniform sampler2D diffuse;
+varying vec2 texCoordVar;
+varying vec4 vertexColor;
 
 void main() {
-	gl_FragColor = vertexColor;
+	gl_FragColor = texture2D(diffuse, texCoordVar) * vertexColor;
 }
@@ -1,10 +1,26 @@
 #ifdef _WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
 #include <GL/glew.h>
+#else
+//declares the instancing entry points the quad renderer uses
+#define GL_GLEXT_PROTOTYPES 1
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
 #endif
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <SDL.h>
 #include <SDL_opengl.h>
 #include <SDL_image.h>
 #include "ShaderProgram.h"
+#include "ObjectPool.h"
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #define STB_IMAGE_IMPLEMENTATION
@@ -12,10 +28,28 @@
 #include <SDL_mixer.h>
 #include <ctime>
 #include <vector>
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <cstdlib>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLE_SIMD
+#endif
 
 using namespace std;
 
@@ -27,204 +61,950 @@ using namespace std;
 
 SDL_Window* displayWindow;
 
+//stages timed by ProfileScope. nested stages (collision inside update, text inside render) overlap their parent
+enum ProfileStage { PROFILE_FRAME, PROFILE_UPDATE, PROFILE_COLLISION, PROFILE_RENDER, PROFILE_TEXT, PROFILE_PARTICLES, PROFILE_STAGE_COUNT };
+const char *profileStageNames[PROFILE_STAGE_COUNT] = { "frame", "update", "collision", "render", "text", "particles" };
+
+//frames kept for the overlay's percentiles
+#define PROFILE_HISTORY 600
+//trace events kept for --trace; older ones are overwritten
+#define PROFILE_MAX_EVENTS 262144
+
+//threads that record samples: the main thread, which owns the frame, and --sim-thread's simulation thread
+enum ProfileThread { PROFILE_MAIN_THREAD, PROFILE_SIMULATION_THREAD, PROFILE_THREAD_COUNT };
+const char *profileThreadNames[PROFILE_THREAD_COUNT] = { "main", "simulation" };
+
+//per-frame stage times in a ring buffer, plus an optional ring of trace events per thread for a Chrome/Perfetto export.
+//stages timed on the simulation thread are added to whichever frame the main thread is on when they finish
+class Profiler {
+public:
+	Profiler();
+
+	double Now() const;
+	void AddSample(ProfileStage stage, double start, double duration);
+	void EndFrame();
+	void EnableTrace();
+	//called from the simulation thread before it records anything
+	void SetSimulationThread();
+
+	float FrameTimePercentile(float percentile);
+	float AverageStageTime(ProfileStage stage) const;
+	bool WriteTrace(const char *path) const;
+
+	class TraceEvent {
+	public:
+		ProfileStage stage;
+		double start;
+		double duration;
+	};
+
+	//written only by its own thread, and read once every thread is done
+	class TraceRing {
+	public:
+		vector<TraceEvent> events;
+		int next;
+		bool wrapped;
+	};
+
+	chrono::high_resolution_clock::time_point origin;
+	double lastFrameEnd;
+	float currentFrame[PROFILE_STAGE_COUNT];
+	float history[PROFILE_HISTORY][PROFILE_STAGE_COUNT];
+	float sortedFrameTimes[PROFILE_HISTORY];
+	int historyNext;
+	int historyCount;
+
+	//simulation thread stage times not yet taken into a frame, in nanoseconds
+	atomic<long long> simulationTime[PROFILE_STAGE_COUNT];
+
+	TraceRing traces[PROFILE_THREAD_COUNT];
+
+	//samples from any thread but these two are dropped
+	thread::id threads[PROFILE_THREAD_COUNT];
+};
+
+Profiler::Profiler() {
+	origin = chrono::high_resolution_clock::now();
+	lastFrameEnd = 0.0;
+	memset(currentFrame, 0, sizeof(currentFrame));
+	historyNext = 0;
+	historyCount = 0;
+	for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+		simulationTime[i] = 0;
+	}
+	for (int i = 0; i < PROFILE_THREAD_COUNT; i++) {
+		traces[i].next = 0;
+		traces[i].wrapped = false;
+	}
+	threads[PROFILE_MAIN_THREAD] = this_thread::get_id();
+}
+
+//microseconds since startup
+double Profiler::Now() const {
+	return chrono::duration<double, micro>(chrono::high_resolution_clock::now() - origin).count();
+}
+
+void Profiler::AddSample(ProfileStage stage, double start, double duration) {
+	thread::id self = this_thread::get_id();
+	int threadIndex;
+	if (self == threads[PROFILE_MAIN_THREAD]) {
+		threadIndex = PROFILE_MAIN_THREAD;
+		currentFrame[stage] += (float)(duration / 1000.0);
+	}
+	else if (self == threads[PROFILE_SIMULATION_THREAD]) {
+		threadIndex = PROFILE_SIMULATION_THREAD;
+		simulationTime[stage] += (long long)(duration * 1000.0);
+	}
+	else { return; }
+
+	TraceRing &trace = traces[threadIndex];
+	if (trace.events.empty()) { return; }
+	TraceEvent &event = trace.events[trace.next];
+	event.stage = stage;
+	event.start = start;
+	event.duration = duration;
+	trace.next++;
+	if (trace.next == (int)trace.events.size()) {
+		trace.next = 0;
+		trace.wrapped = true;
+	}
+}
+
+//closes the frame that started when the previous one ended
+void Profiler::EndFrame() {
+	double now = Now();
+	currentFrame[PROFILE_FRAME] = 0.0f;
+	AddSample(PROFILE_FRAME, lastFrameEnd, now - lastFrameEnd);
+	lastFrameEnd = now;
+	for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+		currentFrame[i] += (float)(simulationTime[i].exchange(0) / 1000000.0);
+	}
+
+	memcpy(history[historyNext], currentFrame, sizeof(currentFrame));
+	historyNext = (historyNext + 1) % PROFILE_HISTORY;
+	historyCount = min(historyCount + 1, PROFILE_HISTORY);
+	memset(currentFrame, 0, sizeof(currentFrame));
+}
+
+void Profiler::EnableTrace() {
+	for (int i = 0; i < PROFILE_THREAD_COUNT; i++) {
+		traces[i].events.resize(PROFILE_MAX_EVENTS);
+	}
+}
+
+void Profiler::SetSimulationThread() {
+	threads[PROFILE_SIMULATION_THREAD] = this_thread::get_id();
+}
+
+float Profiler::FrameTimePercentile(float percentile) {
+	if (historyCount == 0) { return 0.0f; }
+	for (int i = 0; i < historyCount; i++) {
+		sortedFrameTimes[i] = history[i][PROFILE_FRAME];
+	}
+	int rank = min((int)(percentile / 100.0f * historyCount), historyCount - 1);
+	nth_element(sortedFrameTimes, sortedFrameTimes + rank, sortedFrameTimes + historyCount);
+	return sortedFrameTimes[rank];
+}
+
+float Profiler::AverageStageTime(ProfileStage stage) const {
+	if (historyCount == 0) { return 0.0f; }
+	float total = 0.0f;
+	for (int i = 0; i < historyCount; i++) {
+		total += history[i][stage];
+	}
+	return total / historyCount;
+}
+
+//Chrome trace event format, loadable in chrome://tracing and ui.perfetto.dev. each thread gets its own track
+bool Profiler::WriteTrace(const char *path) const {
+	ofstream outfile(path, ios::trunc);
+	if (!outfile) { return false; }
+	outfile << "{\"traceEvents\":[\n";
+	outfile.setf(ios::fixed);
+	outfile.precision(3);
+	for (int threadIndex = 0; threadIndex < PROFILE_THREAD_COUNT; threadIndex++) {
+		outfile << (threadIndex > 0 ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadIndex + 1
+			<< ",\"args\":{\"name\":\"" << profileThreadNames[threadIndex] << "\"}}";
+	}
+	for (int threadIndex = 0; threadIndex < PROFILE_THREAD_COUNT; threadIndex++) {
+		const TraceRing &trace = traces[threadIndex];
+		int count = (trace.wrapped ? (int)trace.events.size() : trace.next);
+		int oldest = (trace.wrapped ? trace.next : 0);
+		for (int i = 0; i < count; i++) {
+			const TraceEvent &event = trace.events[(oldest + i) % trace.events.size()];
+			outfile << ",\n{\"name\":\"" << profileStageNames[event.stage] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadIndex + 1
+				<< ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+		}
+	}
+	outfile << "\n]}\n";
+	return (bool)outfile;
+}
+
+Profiler profiler;
+
+//times the enclosing block into one profiler stage
+class ProfileScope {
+public:
+	ProfileScope(ProfileStage stage_in);
+	~ProfileScope();
+
+	ProfileStage stage;
+	double start;
+};
+
+ProfileScope::ProfileScope(ProfileStage stage_in) {
+	stage = stage_in;
+	start = profiler.Now();
+}
+
+ProfileScope::~ProfileScope() {
+	profiler.AddSample(stage, start, profiler.Now() - start);
+}
+
+//seconds of CPU time used by every thread in the process so far
+double processCpuTime() {
+#ifdef _WINDOWS
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) { return 0.0; }
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+	//FILETIMEs count 100ns ticks
+	return (double)(kernel.QuadPart + user.QuadPart) / 10000000.0;
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec + time.tv_nsec / 1000000000.0;
+#endif
+}
+
+//sleeping can overshoot by a scheduler tick, so the last stretch before a deadline is spun instead
+#define PACER_SPIN_TIME 0.002
+//how often a screen that only changes on input redraws while nothing happens
+#define IDLE_FRAME_TIME 0.1
+//frames stay at the full rate this long after any input, so a quick tap still lands on a step
+#define IDLE_GRACE_TIME 0.5
+
+//keeps the main loop from pinning a core. with vsync the swap itself holds frames to the display; without it
+//Wait sleeps until the frame's deadline. idle screens wait on the event queue at a low rate instead.
+//also tracks CPU use and the spread of frame intervals for the F3 overlay and --frame-stats
+class FramePacer {
+public:
+	FramePacer();
+
+	//after the GL context exists; tries adaptive vsync, then plain vsync, then falls back to sleeping
+	void Setup(bool allowVsync, int targetFPS);
+	//blocks until the next frame should start
+	void Wait(bool idle);
+	void NoteInput();
+
+	double Now() const;
+	float SessionCpuUse() const;
+	float MeanFrameTime() const;
+	float Jitter() const;
+
+	bool vsync;
+	double frameTime;
+	double nextDeadline;
+	double lastInputTime;
+
+	//cpu use over the last second or so, as a fraction of one core
+	float recentCpuUse;
+
+private:
+	chrono::steady_clock::time_point origin;
+	double sessionStart;
+	double sessionCpuStart;
+	double windowStart;
+	double windowCpuStart;
+
+	//running mean and variance of the interval between frames at the full rate
+	double lastFrameStart;
+	long long frameCount;
+	double intervalMean;
+	double intervalM2;
+};
+
+FramePacer::FramePacer() {
+	origin = chrono::steady_clock::now();
+	vsync = false;
+	frameTime = 1.0 / 60.0;
+	nextDeadline = 0.0;
+	lastInputTime = 0.0;
+	recentCpuUse = 0.0f;
+	sessionStart = 0.0;
+	sessionCpuStart = 0.0;
+	windowStart = 0.0;
+	windowCpuStart = 0.0;
+	lastFrameStart = -1.0;
+	frameCount = 0;
+	intervalMean = 0.0;
+	intervalM2 = 0.0;
+}
+
+double FramePacer::Now() const {
+	return chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+}
+
+void FramePacer::Setup(bool allowVsync, int targetFPS) {
+	frameTime = 1.0 / max(targetFPS, 1);
+	vsync = false;
+	if (allowVsync) {
+		//adaptive vsync tears a late frame instead of waiting a whole extra refresh; not every driver has it
+		vsync = (SDL_GL_SetSwapInterval(-1) == 0 || SDL_GL_SetSwapInterval(1) == 0);
+	}
+	else {
+		SDL_GL_SetSwapInterval(0);
+	}
+
+	double now = Now();
+	nextDeadline = now;
+	lastInputTime = now;
+	sessionStart = windowStart = now;
+	sessionCpuStart = windowCpuStart = processCpuTime();
+}
+
+void FramePacer::Wait(bool idle) {
+	double now = Now();
+	idle = idle && (now - lastInputTime > IDLE_GRACE_TIME);
+	if (idle) {
+		//any event ends the wait early, and the loop polls it right after
+		SDL_WaitEventTimeout(NULL, (int)(IDLE_FRAME_TIME * 1000.0));
+		nextDeadline = Now();
+	}
+	else if (!vsync) {
+		if (now < nextDeadline) {
+			double remaining = nextDeadline - now;
+			if (remaining > PACER_SPIN_TIME) {
+				this_thread::sleep_for(chrono::duration<double>(remaining - PACER_SPIN_TIME));
+			}
+			while (Now() < nextDeadline) {
+				this_thread::yield();
+			}
+			nextDeadline += frameTime;
+		}
+		else {
+			//a frame that ran long starts the schedule over instead of rushing the next few to catch up
+			nextDeadline = now + frameTime;
+		}
+	}
+
+	now = Now();
+	if (!idle && lastFrameStart >= 0.0) {
+		double interval = now - lastFrameStart;
+		frameCount++;
+		double delta = interval - intervalMean;
+		intervalMean += delta / frameCount;
+		intervalM2 += delta * (interval - intervalMean);
+	}
+	lastFrameStart = (idle ? -1.0 : now);
+
+	if (now - windowStart >= 1.0) {
+		double cpu = processCpuTime();
+		recentCpuUse = (float)((cpu - windowCpuStart) / (now - windowStart));
+		windowStart = now;
+		windowCpuStart = cpu;
+	}
+}
+
+void FramePacer::NoteInput() {
+	lastInputTime = Now();
+}
+
+float FramePacer::SessionCpuUse() const {
+	double wall = Now() - sessionStart;
+	return (wall > 0.0 ? (float)((processCpuTime() - sessionCpuStart) / wall) : 0.0f);
+}
+
+//in milliseconds
+float FramePacer::MeanFrameTime() const {
+	return (float)(intervalMean * 1000.0);
+}
+
+//standard deviation of the frame interval, in milliseconds
+float FramePacer::Jitter() const {
+	return (frameCount > 1 ? (float)(sqrt(intervalM2 / (frameCount - 1)) * 1000.0) : 0.0f);
+}
+
+FramePacer pacer;
+
+
+
+//a sub-rectangle of a texture atlas, in normalized texture coordinates
+class AtlasRegion {
+	public:
+		AtlasRegion();
+
+		float MapU(float u_in) const;
+		float MapV(float v_in) const;
+
+		GLuint textureID;
+		float u;
+		float v;
+		float width;
+		float height;
+};
 
 class SheetSprite {
 	public:
 		SheetSprite();
-		SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in);
-
-		void Draw(ShaderProgram &program);
+		SheetSprite(const AtlasRegion &region_in, float width_in, float height_in, float size_in);
 
 		float size;
-		GLuint textureID;
-		vector<float> indices;
-		unsigned int currAnimFrame;
+		AtlasRegion region;
 		float u;
 		float v;
 		float width;
 		float height;
+};
 
-		void Animate();
+//one copy of the unit quad as QuadRenderer draws it. the color fades from color to endColor as fade goes
+//from 0 to 1 in the vertex shader, so particles only hand over how far through their lifetime they are
+struct QuadInstance {
+	glm::vec2 position;
+	//a negative width mirrors the quad
+	glm::vec2 size;
+	//left, bottom, right, top in atlas space
+	glm::vec4 uv;
+	glm::vec4 color;
+	glm::vec4 endColor;
+	float fade;
 };
 
-enum EntityType {ENTITY_PLAYER, ENTITY_KEY, ENTITY_DOOR, ENTITY_POI, ENTITY_ENEMY};
+#define QUAD_INSTANCE_ATTRIBUTES 5
 
-class Entity {
+//draws any number of quads with one glDrawArraysInstanced: a static unit quad plus a buffer of QuadInstances,
+//read once per instance. the layout lives in a vertex array object, so a batch costs a bind instead of
+//re-pointing every attribute. contexts older than GL 3.3 get each instance expanded to six vertices instead,
+//which the same shader draws with glDrawArrays
+class QuadRenderer {
 	public:
+		QuadRenderer();
+
+		void Upload(const QuadInstance *instances, int count);
+		//Begin sets up the attributes once, so a batch can be drawn as several texture runs
+		void Begin(ShaderProgram &program);
+		//draws count uploaded instances starting at first. textureID 0 draws them untextured
+		void Draw(GLuint textureID, int first, int count);
+		void End();
+		void Cleanup();
+
+		bool instancing;
+		int drawCalls;
+
+	private:
+		void Setup();
+		void FindAttributes(ShaderProgram &program);
+		void BuildVertexArray(ShaderProgram &program);
+		void PointInstanceAttributes(int first);
+
+		//the fallback's vertices: a corner of the unit quad with its instance's data repeated
+		struct QuadVertex {
+			float corner[4];
+			QuadInstance instance;
+		};
+
+		GLuint quadBuffer;
+		GLuint instanceBuffer;
+		GLuint vertexArray;
+		//the instance the vertex array's instance attributes start at
+		int vertexArrayFirst;
+		//a white texel, so untextured quads go through the same shader
+		GLuint whiteTexture;
+		vector<QuadVertex> expanded;
+
+		//attribute locations, looked up again when the program changes after a hot reload
+		GLuint attributesProgram;
+		GLint instanceAttributes[QUAD_INSTANCE_ATTRIBUTES];
+		ShaderProgram *drawingProgram;
+};
 
-		void Draw(ShaderProgram &program);
-		void Animate(float elapsed);
-		void UpdateX(float elapsed);
-		void UpdateY(float elapsed);
+//collects a frame's sprites and draws them through a QuadRenderer with one draw call per texture
+class SpriteBatch {
+	public:
+		SpriteBatch();
 
-		bool IsColliding(Entity &entity);
+		void Begin();
+		void Add(const SheetSprite &sprite, const glm::vec3 &position, const glm::vec3 &scale);
+		void Flush(ShaderProgram &program, QuadRenderer &renderer);
 
-		glm::vec3 position;
-		glm::vec3 velocity;
-		glm::vec3 size;
-		glm::vec3 acceleration;
+		struct BatchedQuad {
+			GLuint textureID;
+			int order;
+		};
 
-		bool isStatic;
+		vector<BatchedQuad> quads;
+		vector<QuadInstance> instances;
+		vector<QuadInstance> sortedInstances;
+		int drawCalls;
+};
 
-		float rotation;
-		
-		SheetSprite sprite;
+//an entity is only an index into World's component arrays
+typedef int EntityID;
+#define NO_ENTITY -1
+
+//the components an entity can have, one bit each in World::mask. every entity has a position and size;
+//the rest decide which systems pick it up
+enum ComponentBit {
+	COMPONENT_SPRITE = 1 << 0,		//drawn by DrawSystem
+	COMPONENT_BODY = 1 << 1,		//falls, integrates its acceleration and is swept against the tilemap
+	COMPONENT_ANIMATION = 1 << 2,	//steps through an AnimationClip
+	COMPONENT_PLAYER = 1 << 3,		//driven by the keyboard, squishes with its vertical speed
+	COMPONENT_PICKUP = 1 << 4,		//unlocks the level's doors when the player touches it
+	COMPONENT_DOOR = 1 << 5,
+	COMPONENT_SIGN = 1 << 6,		//shows the level's flavor text while the player touches it
+	COMPONENT_CHASER = 1 << 7		//flies at the player when they get near its home, ends the game on contact
+};
 
-		float animFPS;
-		float elapsedSinceLastAnim;
+//bits of World::collided, set by the last tilemap sweep
+#define COLLIDED_TOP 1
+#define COLLIDED_BOTTOM 2
+#define COLLIDED_LEFT 4
+#define COLLIDED_RIGHT 8
 
-		EntityType entityType;
+//an animation's frames as u/v pairs within the sprite's image, shared by every entity playing it
+struct AnimationClip {
+	const float *frames;
+	int frameCount;
+};
 
-		bool collidedTop;
-		bool collidedBottom;
-		bool collidedLeft;
-		bool collidedRight;
+//every entity in the current level as a structure of arrays indexed by EntityID, so each system
+//only walks the columns it uses. columns for components an entity doesn't have keep their defaults,
+//and a removed entity keeps its slot with an empty mask until the next Clear
+class World {
+	public:
+		EntityID Create(unsigned int components, const glm::vec3 &position_in, const glm::vec3 &size_in);
+		void Remove(EntityID entity);
+		void Clear();
+
+		int Count() const;
+		bool Has(EntityID entity, unsigned int components) const;
+		bool Overlapping(EntityID a, EntityID b) const;
+
+		vector<unsigned int> mask;
+		vector<glm::vec3> position;
+		//where each entity was at the start of the current step, for render interpolation
+		vector<glm::vec3> previousPosition;
+		vector<glm::vec3> size;
+		vector<unsigned char> facingRight;
+
+		//COMPONENT_SPRITE
+		vector<SheetSprite> sprite;
+
+		//COMPONENT_BODY; chasers move by velocity too
+		vector<glm::vec3> velocity;
+		vector<glm::vec3> acceleration;
+		vector<float> gravity;
+		vector<unsigned char> collided;
+
+		//COMPONENT_ANIMATION
+		vector<const AnimationClip*> clip;
+		vector<int> animFrame;
+		vector<float> animFPS;
+		vector<float> elapsedSinceLastAnim;
+
+		//COMPONENT_PLAYER
+		vector<glm::vec3> squish;
+
+		//COMPONENT_DOOR
+		vector<unsigned char> isLocked;
+
+		//COMPONENT_CHASER
+		vector<glm::vec3> homePos;
+		vector<unsigned char> isAngry;
+};
 
-		bool facingRight;
-		glm::vec3 squish;
+AtlasRegion::AtlasRegion() {
+	textureID = 0;
+	u = 0.0f;
+	v = 0.0f;
+	width = 1.0f;
+	height = 1.0f;
+}
 
-		//for doors
-		bool isLocked;
+float AtlasRegion::MapU(float u_in) const {
+	return u + u_in * width;
+}
 
-		//for enemies
-		bool isAngry;
-		glm::vec3 resetPos;
-		
-};
+float AtlasRegion::MapV(float v_in) const {
+	return v + v_in * height;
+}
 
 SheetSprite::SheetSprite() {
 	size = 1.0f;
-	textureID = 0;
 	u = 1.0f;
 	v = 1.0f;
 	width = 1.0f;
 	height = 1.0f;
 }
 
-SheetSprite::SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in) {
+SheetSprite::SheetSprite(const AtlasRegion &region_in, float width_in, float height_in, float size_in) {
 	size = size_in;
-	textureID = textureID_in;
+	region = region_in;
 	u = 0.0f;
 	v = 0.0f;
-	currAnimFrame = 0;
 	width = width_in;
 	height = height_in;
 }
 
-void SheetSprite::Draw(ShaderProgram &program) {
-	glBindTexture(GL_TEXTURE_2D, textureID);
+//x, y, u, v for the two triangles of the unit quad
+const float unitQuadCorners[24] = {
+	-0.5f, -0.5f, 0.0f, 0.0f,
+	0.5f, 0.5f, 1.0f, 1.0f,
+	-0.5f, 0.5f, 0.0f, 1.0f,
+	0.5f, 0.5f, 1.0f, 1.0f,
+	-0.5f, -0.5f, 0.0f, 0.0f,
+	0.5f, -0.5f, 1.0f, 0.0f
+};
 
-	GLfloat texCoords[] = {
-		u, v + height,
-		u + width, v,
-		u, v,
-		u + width, v,
-		u, v + height,
-		u + width, v + height
-	};
+const char *quadInstanceAttributeNames[QUAD_INSTANCE_ATTRIBUTES] = { "instanceRect", "instanceUV", "startColor", "endColor", "fade" };
+const int quadInstanceAttributeSizes[QUAD_INSTANCE_ATTRIBUTES] = { 4, 4, 4, 4, 1 };
+//position and size are read together as the rect
+const size_t quadInstanceAttributeOffsets[QUAD_INSTANCE_ATTRIBUTES] = {
+	offsetof(QuadInstance, position), offsetof(QuadInstance, uv), offsetof(QuadInstance, color),
+	offsetof(QuadInstance, endColor), offsetof(QuadInstance, fade)
+};
 
-	float vertices[] = {
-		-0.5f * size, -0.5f * size,
-		0.5f * size, 0.5f * size,
-		-0.5f * size, 0.5f * size,
-		0.5f * size, 0.5f * size,
-		-0.5f * size, -0.5f * size,
-		0.5f * size, -0.5f * size,
-	};
+QuadRenderer::QuadRenderer() {
+	instancing = false;
+	drawCalls = 0;
+	quadBuffer = 0;
+	instanceBuffer = 0;
+	vertexArray = 0;
+	vertexArrayFirst = 0;
+	whiteTexture = 0;
+	attributesProgram = 0;
+	for (int i = 0; i < QUAD_INSTANCE_ATTRIBUTES; i++) { instanceAttributes[i] = -1; }
+	drawingProgram = NULL;
+}
 
-	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 0, vertices);
-	glEnableVertexAttribArray(program.positionAttribute);
+//needs a current GL context, so it runs on the first Upload
+void QuadRenderer::Setup() {
+	//glVertexAttribDivisor became core in 3.3
+	const char *version = (const char*)glGetString(GL_VERSION);
+	int major = 0;
+	int minor = 0;
+	instancing = (version != NULL && sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 3)));
+
+	glGenBuffers(1, &quadBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(unitQuadCorners), unitQuadCorners, GL_STATIC_DRAW);
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures(1, &whiteTexture);
+	glBindTexture(GL_TEXTURE_2D, whiteTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void QuadRenderer::FindAttributes(ShaderProgram &program) {
+	if (attributesProgram == program.programID) { return; }
+	attributesProgram = program.programID;
+	for (int i = 0; i < QUAD_INSTANCE_ATTRIBUTES; i++) {
+		instanceAttributes[i] = glGetAttribLocation(program.programID, quadInstanceAttributeNames[i]);
+	}
+	if (instancing) { BuildVertexArray(program); }
+}
 
-	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 0, texCoords);
+//records where every attribute of program reads from. a reloaded program can put its attributes in other slots,
+//so it gets a new vertex array rather than one with the old slots still enabled
+void QuadRenderer::BuildVertexArray(ShaderProgram &program) {
+	if (vertexArray != 0) { glDeleteVertexArrays(1, &vertexArray); }
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+
+	glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(program.positionAttribute);
+	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 	glEnableVertexAttribArray(program.texCoordAttribute);
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisableVertexAttribArray(program.positionAttribute);
-	glDisableVertexAttribArray(program.texCoordAttribute);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	PointInstanceAttributes(0);
+	for (int i = 0; i < QUAD_INSTANCE_ATTRIBUTES; i++) {
+		if (instanceAttributes[i] < 0) { continue; }
+		glEnableVertexAttribArray(instanceAttributes[i]);
+		glVertexAttribDivisor(instanceAttributes[i], 1);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void SheetSprite::Animate() {
-	u = indices[currAnimFrame];
-	v = indices[currAnimFrame + 1];
-	
-	currAnimFrame += 2;
-	if (currAnimFrame >= indices.size()) { currAnimFrame = 0; }
+//needs the vertex array and the instance buffer bound
+void QuadRenderer::PointInstanceAttributes(int first) {
+	for (int i = 0; i < QUAD_INSTANCE_ATTRIBUTES; i++) {
+		if (instanceAttributes[i] < 0) { continue; }
+		glVertexAttribPointer(instanceAttributes[i], quadInstanceAttributeSizes[i], GL_FLOAT, false, sizeof(QuadInstance),
+			(void*)(first * sizeof(QuadInstance) + quadInstanceAttributeOffsets[i]));
+	}
+	vertexArrayFirst = first;
 }
 
-bool Entity::IsColliding(Entity &entity) {
-	float e1HalfWidth = (sprite.size * size[0]) / 2.0f;
-	float e1HalfHeight = (sprite.size * size[1]) / 2.0f;
-	float e2HalfWidth = (entity.sprite.size * entity.size[0]) / 2.0f;
-	float e2HalfHeight = (entity.sprite.size * entity.size[1]) / 2.0f;
-	bool xOverlap = ((float)abs(entity.position[0] - position[0]) <= e1HalfWidth + e2HalfWidth);
-	bool yOverlap = ((float)abs(entity.position[1] - position[1]) <= e1HalfHeight + e2HalfHeight);
-	return (xOverlap && yOverlap);
+//a fresh store each time, so uploading doesn't wait for the GPU to finish drawing the last batch
+void QuadRenderer::Upload(const QuadInstance *instances, int count) {
+	if (quadBuffer == 0) { Setup(); }
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	if (instancing) {
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(QuadInstance), instances, GL_STREAM_DRAW);
+	}
+	else {
+		expanded.resize(count * 6);
+		for (int i = 0; i < count; i++) {
+			for (int corner = 0; corner < 6; corner++) {
+				QuadVertex &vertex = expanded[i * 6 + corner];
+				memcpy(vertex.corner, &unitQuadCorners[corner * 4], sizeof(vertex.corner));
+				vertex.instance = instances[i];
+			}
+		}
+		glBufferData(GL_ARRAY_BUFFER, expanded.size() * sizeof(QuadVertex), expanded.data(), GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-float lerp(float v0, float v1, float t) {
-	return (float)((1.0 - t)*v0 + t * v1);
+void QuadRenderer::Begin(ShaderProgram &program) {
+	FindAttributes(program);
+	drawingProgram = &program;
+	program.SetModelMatrix(glm::mat4(1.0f));
+
+	if (instancing) {
+		glBindVertexArray(vertexArray);
+		return;
+	}
+
+	//the expanded vertices never move, so the fallback points every attribute here and Draw only picks the range
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, sizeof(QuadVertex), (void*)0);
+	glEnableVertexAttribArray(program.positionAttribute);
+	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, sizeof(QuadVertex), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(program.texCoordAttribute);
+	for (int i = 0; i < QUAD_INSTANCE_ATTRIBUTES; i++) {
+		if (instanceAttributes[i] < 0) { continue; }
+		glVertexAttribPointer(instanceAttributes[i], quadInstanceAttributeSizes[i], GL_FLOAT, false, sizeof(QuadVertex),
+			(void*)(offsetof(QuadVertex, instance) + quadInstanceAttributeOffsets[i]));
+		glEnableVertexAttribArray(instanceAttributes[i]);
+	}
 }
 
-void Entity::Animate(float elapsed) {
-	elapsedSinceLastAnim += elapsed;
-	if (elapsedSinceLastAnim >= 1.0f / animFPS) {
-		sprite.Animate();
-		elapsedSinceLastAnim = 0.0f;
+void QuadRenderer::Draw(GLuint textureID, int first, int count) {
+	if (count <= 0 || drawingProgram == NULL) { return; }
+	glBindTexture(GL_TEXTURE_2D, (textureID != 0 ? textureID : whiteTexture));
+
+	if (instancing) {
+		//without a base instance, a run starting partway through the buffer moves the instance pointers instead
+		if (first != vertexArrayFirst) {
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			PointInstanceAttributes(first);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
 	}
+	else {
+		glDrawArrays(GL_TRIANGLES, first * 6, count * 6);
+	}
+	drawCalls++;
+}
 
-	//squish
-	squish[0] = lerp(1.0f, 0.7f, abs(velocity[1] / 2.0f));
-	squish[1] = lerp(1.0f, 1.5f, abs(velocity[1] / 2.0f));
+//the vertex array keeps its divisors and enabled slots to itself, so the instanced path only has to unbind it
+void QuadRenderer::End() {
+	if (drawingProgram == NULL) { return; }
+	if (instancing) {
+		glBindVertexArray(0);
+	}
+	else {
+		for (int i = 0; i < QUAD_INSTANCE_ATTRIBUTES; i++) {
+			if (instanceAttributes[i] >= 0) { glDisableVertexAttribArray(instanceAttributes[i]); }
+		}
+		glDisableVertexAttribArray(drawingProgram->positionAttribute);
+		glDisableVertexAttribArray(drawingProgram->texCoordAttribute);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	drawingProgram = NULL;
 }
 
-void Entity::UpdateX(float elapsed) {
-	if (!isStatic) {
-		velocity[0] += acceleration[0] * elapsed;
-		velocity[0] = lerp(velocity[0], 0.0f, 2.0f * elapsed);
-		position[0] += velocity[0] * elapsed;
+void QuadRenderer::Cleanup() {
+	if (vertexArray != 0) {
+		glDeleteVertexArrays(1, &vertexArray);
+		vertexArray = 0;
 	}
+	if (quadBuffer != 0) {
+		glDeleteBuffers(1, &quadBuffer);
+		glDeleteBuffers(1, &instanceBuffer);
+		glDeleteTextures(1, &whiteTexture);
+		quadBuffer = instanceBuffer = whiteTexture = 0;
+	}
+	attributesProgram = 0;
 }
 
-void Entity::UpdateY(float elapsed) {
-	if (!isStatic) {
-		velocity[1] += acceleration[1] * elapsed;
-		//velocity[1] = lerp(velocity[1], 0.0f, 0.5f * elapsed);
-		position[1] += velocity[1] * elapsed;
+SpriteBatch::SpriteBatch() {
+	drawCalls = 0;
+}
+
+void SpriteBatch::Begin() {
+	quads.clear();
+	instances.clear();
+	drawCalls = 0;
+}
+
+void SpriteBatch::Add(const SheetSprite &sprite, const glm::vec3 &position, const glm::vec3 &scale) {
+	QuadInstance instance;
+	instance.position = glm::vec2(position[0], position[1]);
+	instance.size = glm::vec2(sprite.size * scale[0], sprite.size * scale[1]);
+	//sprite u/v are relative to its own image, so move them into atlas space here
+	instance.uv = glm::vec4(sprite.region.MapU(sprite.u), sprite.region.MapV(sprite.v + sprite.height),
+		sprite.region.MapU(sprite.u + sprite.width), sprite.region.MapV(sprite.v));
+	instance.color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	instance.endColor = instance.color;
+	instance.fade = 0.0f;
+
+	BatchedQuad quad;
+	quad.textureID = sprite.region.textureID;
+	quad.order = (int)quads.size();
+	quads.push_back(quad);
+	instances.push_back(instance);
+}
+
+//sorting groups quads by texture, so overlapping sprites from different textures
+//are only layered correctly relative to each other across separate Flush calls
+void SpriteBatch::Flush(ShaderProgram &program, QuadRenderer &renderer) {
+	if (quads.empty()) { return; }
+
+	stable_sort(quads.begin(), quads.end(), [](const BatchedQuad &a, const BatchedQuad &b) {
+		return a.textureID < b.textureID;
+	});
+
+	sortedInstances.clear();
+	for (int i = 0; i < (int)quads.size(); i++) {
+		sortedInstances.push_back(instances[quads[i].order]);
 	}
+	renderer.Upload(sortedInstances.data(), (int)sortedInstances.size());
+
+	renderer.Begin(program);
+	int runStart = 0;
+	for (int i = 1; i <= (int)quads.size(); i++) {
+		if (i == (int)quads.size() || quads[i].textureID != quads[runStart].textureID) {
+			renderer.Draw(quads[runStart].textureID, runStart, i - runStart);
+			drawCalls++;
+			runStart = i;
+		}
+	}
+	renderer.End();
+
+	quads.clear();
+	instances.clear();
 }
 
-void Entity::Draw(ShaderProgram &program) {
-	glm::mat4 modelMatrix = glm::mat4(1.0f);
-	modelMatrix = glm::translate(modelMatrix, position);
-	modelMatrix = glm::scale(modelMatrix, glm::vec3((facingRight ? size[0] : -size[0]), size[1], size[2]));
-	if (entityType == ENTITY_PLAYER) { modelMatrix = glm::scale(modelMatrix, squish); }
+EntityID World::Create(unsigned int components, const glm::vec3 &position_in, const glm::vec3 &size_in) {
+	mask.push_back(components);
+	position.push_back(position_in);
+	previousPosition.push_back(position_in);
+	size.push_back(size_in);
+	facingRight.push_back(true);
+	sprite.push_back(SheetSprite());
+	velocity.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
+	acceleration.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
+	gravity.push_back(0.0f);
+	collided.push_back(0);
+	clip.push_back(NULL);
+	animFrame.push_back(0);
+	animFPS.push_back(1.0f);
+	elapsedSinceLastAnim.push_back(0.0f);
+	squish.push_back(glm::vec3(1.0f, 1.0f, 1.0f));
+	isLocked.push_back(false);
+	homePos.push_back(position_in);
+	isAngry.push_back(false);
+	return (EntityID)mask.size() - 1;
+}
 
-	program.SetModelMatrix(modelMatrix);
-	sprite.Draw(program);
+void World::Remove(EntityID entity) {
+	mask[entity] = 0;
 }
 
-class Particle {
-public:
-	Particle(float lifetime_in, glm::vec3 position_in);
+//keeps every column's capacity, so reloading a level doesn't allocate
+void World::Clear() {
+	mask.clear();
+	position.clear();
+	previousPosition.clear();
+	size.clear();
+	facingRight.clear();
+	sprite.clear();
+	velocity.clear();
+	acceleration.clear();
+	gravity.clear();
+	collided.clear();
+	clip.clear();
+	animFrame.clear();
+	animFPS.clear();
+	elapsedSinceLastAnim.clear();
+	squish.clear();
+	isLocked.clear();
+	homePos.clear();
+	isAngry.clear();
+}
 
-	glm::vec3 position;
-	glm::vec3 velocity;
-	float lifetime;
-};
+int World::Count() const {
+	return (int)mask.size();
+}
 
-Particle::Particle(float lifetime_in, glm::vec3 position_in) {
-	position = position_in;
-	velocity = glm::vec3(0.0f);
-	lifetime = lifetime_in;
+bool World::Has(EntityID entity, unsigned int components) const {
+	return (mask[entity] & components) == components;
+}
+
+bool World::Overlapping(EntityID a, EntityID b) const {
+	float aHalfWidth = size[a][0] / 2.0f;
+	float aHalfHeight = size[a][1] / 2.0f;
+	float bHalfWidth = size[b][0] / 2.0f;
+	float bHalfHeight = size[b][1] / 2.0f;
+	bool xOverlap = ((float)abs(position[b][0] - position[a][0]) <= aHalfWidth + bHalfWidth);
+	bool yOverlap = ((float)abs(position[b][1] - position[a][1]) <= aHalfHeight + bHalfHeight);
+	return (xOverlap && yOverlap);
+}
+
+float lerp(float v0, float v1, float t) {
+	return (float)((1.0 - t)*v0 + t * v1);
+}
+
+//particles are stored as a structure of arrays so the update loop can work on 4 of them at a time
+//with SSE. every array is 16-byte aligned and padded to a multiple of 4; padding lanes are updated but never drawn
+#define PARTICLE_LANES 4
+//about the 100 pixel points particles were first drawn as
+#define PARTICLE_SIZE 0.28f
+
+float *allocateAlignedFloats(size_t count) {
+#ifdef _WINDOWS
+	return (float*)_aligned_malloc(count * sizeof(float), 16);
+#else
+	void *memory = NULL;
+	if (posix_memalign(&memory, 16, count * sizeof(float)) != 0) { return NULL; }
+	return (float*)memory;
+#endif
+}
+
+void freeAlignedFloats(float *memory) {
+#ifdef _WINDOWS
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
 }
 
 class ParticleEmitter {
 public:
-	ParticleEmitter(unsigned int particleCount, float maxLifetime_in,
+	ParticleEmitter();
+	ParticleEmitter(unsigned int particleCount_in, float maxLifetime_in,
 		glm::vec3 position_in, glm::vec3 gravity_in);
+	ParticleEmitter(const ParticleEmitter &other);
+	ParticleEmitter &operator=(const ParticleEmitter &other);
+	~ParticleEmitter();
 
+	void Reset(unsigned int particleCount_in, float maxLifetime_in, glm::vec3 position_in, glm::vec3 gravity_in);
 	void Update(float elapsed);
-	void Render(ShaderProgram &program);
+	void AppendInstances(vector<QuadInstance> &instances) const;
 	
 	glm::vec3 position;
 	glm::vec3 gravity;
@@ -234,133 +1014,731 @@ public:
 
 	glm::vec4 startColor;
 	glm::vec4 endColor;
-	
-	std::vector<Particle> particles;
+	//width of each particle's square, in world units
+	float size;
+
+	unsigned int particleCount;
+	unsigned int capacity;
+	float *x;
+	float *y;
+	float *vx;
+	float *vy;
+	float *lifetime;
+
+	//one xorshift32 generator per SIMD lane
+	uint32_t rngState[PARTICLE_LANES];
+
+private:
+	void Allocate(unsigned int particleCount_in);
+	void Free();
 };
 
-void ParticleEmitter::Update(float elapsed) {
-	float randPercent;
-	for (int i = 0; i < particles.size(); i++) {
-		particles[i].velocity[0] += gravity[0] * elapsed;
-		particles[i].velocity[1] += gravity[1] * elapsed;
-		particles[i].position[0] += particles[i].velocity[0] * elapsed;
-		particles[i].position[1] += particles[i].velocity[1] * elapsed;
-
-		particles[i].lifetime += elapsed;
-		if (particles[i].lifetime > maxLifetime) {
-			//reset particle
-			particles[i].velocity = velocity;
-			particles[i].position = position;
-			particles[i].lifetime -= maxLifetime;
+void ParticleEmitter::Allocate(unsigned int particleCount_in) {
+	particleCount = particleCount_in;
+	capacity = (particleCount + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+	x = NULL;
+	if (capacity > 0) {
+		x = allocateAlignedFloats(capacity * 5);
+		memset(x, 0, capacity * 5 * sizeof(float));
+	}
+	y = x + capacity;
+	vx = y + capacity;
+	vy = vx + capacity;
+	lifetime = vy + capacity;
+}
 
-			randPercent = (float)((rand() % 201) - 100) / 100.0f;
-			particles[i].velocity[0] += randPercent * velocityDeviation[0];
-			particles[i].velocity[1] += randPercent * velocityDeviation[1];
+void ParticleEmitter::Free() {
+	if (x != NULL) { freeAlignedFloats(x); }
+	x = y = vx = vy = lifetime = NULL;
+	particleCount = capacity = 0;
+}
 
-		}
+//an empty emitter for pools to Reset later. it leaves rand() alone so replays stay deterministic
+ParticleEmitter::ParticleEmitter() {
+	maxLifetime = 0.0f;
+	position = glm::vec3(0.0f);
+	gravity = glm::vec3(0.0f);
+	velocity = glm::vec3(0.0f);
+	velocityDeviation = glm::vec3(0.1f);
+	startColor = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+	endColor = glm::vec4(0.0f, 0.0f, 1.0f, 0.2f);
+	size = PARTICLE_SIZE;
+	memset(rngState, 0, sizeof(rngState));
+	Allocate(0);
+}
 
-	}
+ParticleEmitter::ParticleEmitter(unsigned int particleCount_in, float maxLifetime_in, glm::vec3 position_in, glm::vec3 gravity_in) {
+	x = NULL;
+	Reset(particleCount_in, maxLifetime_in, position_in, gravity_in);
 }
 
-ParticleEmitter::ParticleEmitter(unsigned int particleCount, float maxLifetime_in, glm::vec3 position_in, glm::vec3 gravity_in) {
+//restarts the emitter in place, keeping its particle arrays when the padded size is unchanged
+void ParticleEmitter::Reset(unsigned int particleCount_in, float maxLifetime_in, glm::vec3 position_in, glm::vec3 gravity_in) {
 	maxLifetime = maxLifetime_in;
 	position = position_in;
 	gravity = gravity_in;
 	velocity = glm::vec3(0.0f);
 	velocityDeviation = glm::vec3(0.1f);
-	float lifetime, randPercent;
-	for (int i = 0; i < particleCount; i++) {
-		lifetime = ((float)((rand() % 100) + 1) / 100.0f) * maxLifetime;
-		particles.push_back(*new Particle(lifetime, position));
+	for (int lane = 0; lane < PARTICLE_LANES; lane++) {
+		rngState[lane] = (uint32_t)rand() * 2654435761u + lane + 1;
+		if (rngState[lane] == 0) { rngState[lane] = 1; }
+	}
+
+	if (x != NULL && (particleCount_in + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES == capacity) {
+		particleCount = particleCount_in;
+	}
+	else {
+		if (x != NULL) { Free(); }
+		Allocate(particleCount_in);
+	}
+	float randPercent;
+	for (unsigned int i = 0; i < capacity; i++) {
+		lifetime[i] = ((float)((rand() % 100) + 1) / 100.0f) * maxLifetime;
+		x[i] = position[0];
+		y[i] = position[1];
 
 		randPercent = (float)((rand() % 201) - 100) / 100.0f;
-		particles[i].velocity[0] += randPercent * velocityDeviation[0];
-		particles[i].velocity[1] += randPercent * velocityDeviation[1];
+		vx[i] = randPercent * velocityDeviation[0];
+		vy[i] = randPercent * velocityDeviation[1];
 	}
 	//startColor = glm::vec4(0.81f, 0.263f, 0.11f, 1.0f);
 	//endColor = glm::vec4(0.22f, 0.157f, 0.1333f, 0.2f);
 	startColor = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
 	endColor = glm::vec4(0.0f, 0.0f, 1.0f, 0.2f);
+	size = PARTICLE_SIZE;
 }
 
-void ParticleEmitter::Render(ShaderProgram &program) {
-	program.SetModelMatrix(glm::mat4(1.0f));
-	program.SetColor(1.0f, 0.0f, 0.0f, 1.0f);
+ParticleEmitter::ParticleEmitter(const ParticleEmitter &other) {
+	x = NULL;
+	*this = other;
+}
 
-	glPointSize(100.0f);
+ParticleEmitter &ParticleEmitter::operator=(const ParticleEmitter &other) {
+	if (this == &other) { return *this; }
+	if (x != NULL) { Free(); }
+	position = other.position;
+	gravity = other.gravity;
+	velocity = other.velocity;
+	velocityDeviation = other.velocityDeviation;
+	maxLifetime = other.maxLifetime;
+	startColor = other.startColor;
+	endColor = other.endColor;
+	size = other.size;
+	memcpy(rngState, other.rngState, sizeof(rngState));
+	Allocate(other.particleCount);
+	if (capacity > 0) { memcpy(x, other.x, capacity * 5 * sizeof(float)); }
+	return *this;
+}
 
-	vector<float> vertices;
-	for (int i = 0; i < particles.size(); i++) {
-		vertices.push_back(particles[i].position[0]);
-		vertices.push_back(particles[i].position[1]);
-	}
+ParticleEmitter::~ParticleEmitter() {
+	Free();
+}
 
-	vector<float> particleColors;
-	for (int i = 0; i < particles.size(); i++) {
-		float relativeLifetime = (particles[i].lifetime / maxLifetime);
-		particleColors.push_back(lerp(startColor[0], endColor[0], relativeLifetime));
-		particleColors.push_back(lerp(startColor[1], endColor[1], relativeLifetime));
-		particleColors.push_back(lerp(startColor[2], endColor[2], relativeLifetime));
-		particleColors.push_back(lerp(startColor[3], endColor[3], relativeLifetime));
+void ParticleEmitter::Update(float elapsed) {
+	float lifetimeMax = maxLifetime;
+#ifdef PARTICLE_SIMD
+	__m128 dt = _mm_set1_ps(elapsed);
+	__m128 gravityX = _mm_set1_ps(gravity[0] * elapsed);
+	__m128 gravityY = _mm_set1_ps(gravity[1] * elapsed);
+	__m128 maxLife = _mm_set1_ps(lifetimeMax);
+	__m128 spawnX = _mm_set1_ps(position[0]);
+	__m128 spawnY = _mm_set1_ps(position[1]);
+	__m128 spawnVX = _mm_set1_ps(velocity[0]);
+	__m128 spawnVY = _mm_set1_ps(velocity[1]);
+	__m128 deviationX = _mm_set1_ps(velocityDeviation[0]);
+	__m128 deviationY = _mm_set1_ps(velocityDeviation[1]);
+	__m128i one = _mm_set1_epi32(0x3f800000);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 three = _mm_set1_ps(3.0f);
+	__m128i rng = _mm_loadu_si128((const __m128i*)rngState);
+
+	for (unsigned int i = 0; i < capacity; i += PARTICLE_LANES) {
+		__m128 px = _mm_load_ps(x + i);
+		__m128 py = _mm_load_ps(y + i);
+		__m128 pvx = _mm_add_ps(_mm_load_ps(vx + i), gravityX);
+		__m128 pvy = _mm_add_ps(_mm_load_ps(vy + i), gravityY);
+		px = _mm_add_ps(px, _mm_mul_ps(pvx, dt));
+		py = _mm_add_ps(py, _mm_mul_ps(pvy, dt));
+		__m128 life = _mm_add_ps(_mm_load_ps(lifetime + i), dt);
+
+		//xorshift32, then the top 23 bits become a float in [-1, 1)
+		rng = _mm_xor_si128(rng, _mm_slli_epi32(rng, 13));
+		rng = _mm_xor_si128(rng, _mm_srli_epi32(rng, 17));
+		rng = _mm_xor_si128(rng, _mm_slli_epi32(rng, 5));
+		__m128 randPercent = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(rng, 9), one));
+		randPercent = _mm_sub_ps(_mm_mul_ps(randPercent, two), three);
+
+		//reset the particles that ran past their lifetime
+		__m128 expired = _mm_cmpgt_ps(life, maxLife);
+		__m128 resetVX = _mm_add_ps(spawnVX, _mm_mul_ps(randPercent, deviationX));
+		__m128 resetVY = _mm_add_ps(spawnVY, _mm_mul_ps(randPercent, deviationY));
+		px = _mm_or_ps(_mm_and_ps(expired, spawnX), _mm_andnot_ps(expired, px));
+		py = _mm_or_ps(_mm_and_ps(expired, spawnY), _mm_andnot_ps(expired, py));
+		pvx = _mm_or_ps(_mm_and_ps(expired, resetVX), _mm_andnot_ps(expired, pvx));
+		pvy = _mm_or_ps(_mm_and_ps(expired, resetVY), _mm_andnot_ps(expired, pvy));
+		life = _mm_sub_ps(life, _mm_and_ps(expired, maxLife));
+
+		_mm_store_ps(x + i, px);
+		_mm_store_ps(y + i, py);
+		_mm_store_ps(vx + i, pvx);
+		_mm_store_ps(vy + i, pvy);
+		_mm_store_ps(lifetime + i, life);
 	}
-
-	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 0, vertices.data());
-	glEnableVertexAttribArray(program.positionAttribute);
-
-	//GLuint colorAttribute = glGetAttribLocation(program.programID, "color");
-	//glVertexAttribPointer(colorAttribute, 4, GL_FLOAT, false, 0, particleColors.data());
-	//glEnableVertexAttribArray(colorAttribute);
-
-	glDrawArrays(GL_POINTS, 0, particles.size());
-	glDisableVertexAttribArray(program.positionAttribute);
-	//glDisableVertexAttribArray(colorAttribute);
+	_mm_storeu_si128((__m128i*)rngState, rng);
+#else
+	float gravityX = gravity[0] * elapsed;
+	float gravityY = gravity[1] * elapsed;
+	for (unsigned int i = 0; i < capacity; i++) {
+		vx[i] += gravityX;
+		vy[i] += gravityY;
+		x[i] += vx[i] * elapsed;
+		y[i] += vy[i] * elapsed;
+
+		uint32_t &state = rngState[i % PARTICLE_LANES];
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		lifetime[i] += elapsed;
+		if (lifetime[i] > lifetimeMax) {
+			//reset particle
+			uint32_t bits = (state >> 9) | 0x3f800000;
+			float randPercent;
+			memcpy(&randPercent, &bits, sizeof(float));
+			randPercent = randPercent * 2.0f - 3.0f;
+
+			x[i] = position[0];
+			y[i] = position[1];
+			vx[i] = velocity[0] + randPercent * velocityDeviation[0];
+			vy[i] = velocity[1] + randPercent * velocityDeviation[1];
+			lifetime[i] -= lifetimeMax;
+		}
+	}
+#endif
 }
 
-GLuint LoadTextureNearest(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
+//one untextured quad per live particle. the shader blends startColor into endColor by the fade written here
+void ParticleEmitter::AppendInstances(vector<QuadInstance> &instances) const {
+	QuadInstance instance;
+	instance.size = glm::vec2(size, size);
+	instance.uv = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	instance.color = startColor;
+	instance.endColor = endColor;
+	float lifetimeScale = 1.0f / maxLifetime;
+	for (unsigned int i = 0; i < particleCount; i++) {
+		instance.position = glm::vec2(x[i], y[i]);
+		instance.fade = lifetime[i] * lifetimeScale;
+		instances.push_back(instance);
+	}
+}
 
-	if (image == NULL) {
-		cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
+//--bench-particles: time the update kernel for one large emitter
+void BenchmarkParticles(unsigned int particleCount) {
+	ParticleEmitter emitter(particleCount, 3.0f, glm::vec3(0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	const int steps = 600;
+	const float elapsed = 1.0f / 60.0f;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int step = 0; step < steps; step++) {
+		emitter.Update(elapsed);
 	}
+	double total = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	cout << particleCount << " particles, " << steps << " steps: " << total / steps << " ms/step\n";
+}
 
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+#define ATLAS_PADDING 2
+
+//packs several images into one texture at startup so sprites, text and tiles can share a binding
+class TextureAtlas {
+	public:
+		TextureAtlas();
+
+		int Add(const char *filePath);
+		int Add(unsigned char *pixels, int width, int height);
+		void Build();
+		AtlasRegion GetRegion(int index);
+		void Cleanup();
+
+		struct AtlasImage {
+			int width;
+			int height;
+			int x;
+			int y;
+			unsigned char *pixels;
+		};
+
+		vector<AtlasImage> images;
+		GLuint textureID;
+		int atlasWidth;
+		int atlasHeight;
+};
+
+TextureAtlas::TextureAtlas() {
+	textureID = 0;
+	atlasWidth = 0;
+	atlasHeight = 0;
+}
+
+int TextureAtlas::Add(const char *filePath) {
+	int width, height, comp;
+	unsigned char *pixels = stbi_load(filePath, &width, &height, &comp, STBI_rgb_alpha);
+
+	if (pixels == NULL) {
+		cout << "Unable to load image. Make sure the path is correct\n";
+		assert(false);
+	}
+
+	return Add(pixels, width, height);
+}
+
+//takes ownership of RGBA pixels already decoded with stbi_load
+int TextureAtlas::Add(unsigned char *pixels, int width, int height) {
+	AtlasImage image;
+	image.width = width;
+	image.height = height;
+	image.x = 0;
+	image.y = 0;
+	image.pixels = pixels;
+	images.push_back(image);
+	return (int)images.size() - 1;
+}
+
+void TextureAtlas::Build() {
+	//shelf pack, tallest first, into the smallest power of two square-ish atlas that fits
+	vector<int> order;
+	for (int i = 0; i < (int)images.size(); i++) { order.push_back(i); }
+	sort(order.begin(), order.end(), [this](int a, int b) {
+		return images[a].height > images[b].height;
+	});
+
+	GLint maxSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+
+	for (atlasWidth = 256; atlasWidth <= maxSize; atlasWidth *= 2) {
+		int shelfX = 0;
+		int shelfY = 0;
+		int shelfHeight = 0;
+		bool fits = true;
+		for (int i = 0; i < (int)order.size(); i++) {
+			AtlasImage &image = images[order[i]];
+			int paddedWidth = image.width + 2 * ATLAS_PADDING;
+			int paddedHeight = image.height + 2 * ATLAS_PADDING;
+			if (paddedWidth > atlasWidth) { fits = false; break; }
+			if (shelfX + paddedWidth > atlasWidth) {
+				shelfY += shelfHeight;
+				shelfX = 0;
+				shelfHeight = 0;
+			}
+			image.x = shelfX + ATLAS_PADDING;
+			image.y = shelfY + ATLAS_PADDING;
+			shelfX += paddedWidth;
+			shelfHeight = (paddedHeight > shelfHeight ? paddedHeight : shelfHeight);
+		}
+		for (atlasHeight = 1; atlasHeight < shelfY + shelfHeight; atlasHeight *= 2) {}
+		if (fits && atlasHeight <= atlasWidth) { break; }
+	}
+
+	if (atlasWidth > maxSize) {
+		cout << "Unable to fit images into a texture atlas\n";
+		assert(false);
+	}
+
+	//copy each image in, then extrude its edge pixels into the padding so filtering never bleeds in a neighbour
+	vector<unsigned char> atlasPixels(atlasWidth * atlasHeight * 4, 0);
+	for (int i = 0; i < (int)images.size(); i++) {
+		AtlasImage &image = images[i];
+		for (int y = -ATLAS_PADDING; y < image.height + ATLAS_PADDING; y++) {
+			int srcY = (y < 0 ? 0 : (y >= image.height ? image.height - 1 : y));
+			for (int x = -ATLAS_PADDING; x < image.width + ATLAS_PADDING; x++) {
+				int srcX = (x < 0 ? 0 : (x >= image.width ? image.width - 1 : x));
+				unsigned char *src = &image.pixels[(srcY * image.width + srcX) * 4];
+				unsigned char *dst = &atlasPixels[((image.y + y) * atlasWidth + (image.x + x)) * 4];
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+				dst[3] = src[3];
+			}
+		}
+		stbi_image_free(image.pixels);
+		image.pixels = NULL;
+	}
+
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlasWidth, atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, atlasPixels.data());
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+AtlasRegion TextureAtlas::GetRegion(int index) {
+	AtlasRegion region;
+	region.textureID = textureID;
+	region.u = (float)images[index].x / (float)atlasWidth;
+	region.v = (float)images[index].y / (float)atlasHeight;
+	region.width = (float)images[index].width / (float)atlasWidth;
+	region.height = (float)images[index].height / (float)atlasHeight;
+	return region;
+}
 
-	stbi_image_free(image);
-	return retTexture;
+void TextureAtlas::Cleanup() {
+	glDeleteTextures(1, &textureID);
+	textureID = 0;
+	images.clear();
 }
 
-GLuint LoadTextureLinear(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
+//decodes the images and audio listed in a manifest on a pool of worker threads, so the GL thread only has to
+//upload them. manifest lines are "<image|sound|music> <name> <file>"; blank lines and # comments are skipped
+class AssetManager {
+	public:
+		AssetManager();
+		~AssetManager();
+
+		bool Start(const char *manifestPath, bool loadAudio);
+		void Finish();
+		int AddToAtlas(TextureAtlas &atlas, const string &name);
+		Mix_Chunk *Sound(const string &name);
+		Mix_Music *Music(const string &name);
+		void Cleanup();
+
+		enum AssetKind {ASSET_IMAGE, ASSET_SOUND, ASSET_MUSIC};
+
+		struct Asset {
+			AssetKind kind;
+			string name;
+			string path;
+			int width;
+			int height;
+			unsigned char *pixels;
+			Mix_Chunk *chunk;
+			Mix_Music *music;
+		};
+
+		vector<Asset> assets;
+		int workerCount;
+		double decodeTime;
+
+	private:
+		void Decode();
+		Asset *Find(AssetKind kind, const string &name);
+
+		vector<thread> workers;
+		atomic<int> nextAsset;
+		//SDL_mixer's loaders aren't documented as thread-safe, so workers take turns with them
+		mutex audioMutex;
+		chrono::high_resolution_clock::time_point startTime;
+};
 
-	if (image == NULL) {
-		cout << "Unable to load image. Make sure the path is correct\n";
+AssetManager::AssetManager() {
+	unsigned int cores = thread::hardware_concurrency();
+	workerCount = (cores > 0 ? (int)cores : 4);
+	decodeTime = 0.0;
+	nextAsset = 0;
+}
+
+AssetManager::~AssetManager() {
+	Finish();
+}
+
+//reads the manifest and starts decoding in the background; audio entries are skipped unless loadAudio is set,
+//since SDL_mixer converts sounds to the format of the open audio device
+bool AssetManager::Start(const char *manifestPath, bool loadAudio) {
+	ifstream manifest(manifestPath);
+	if (!manifest) { return false; }
+
+	Finish();
+	string line;
+	while (getline(manifest, line)) {
+		istringstream sStream(line);
+		string kind, name, file;
+		if (!(sStream >> kind) || kind[0] == '#') { continue; }
+		sStream >> name >> file;
+
+		Asset asset;
+		if (kind == "image") { asset.kind = ASSET_IMAGE; }
+		else if (kind == "sound") { asset.kind = ASSET_SOUND; }
+		else if (kind == "music") { asset.kind = ASSET_MUSIC; }
+		else {
+			cout << "Unknown asset kind " << kind << " in " << manifestPath << "\n";
+			return false;
+		}
+		if (asset.kind != ASSET_IMAGE && !loadAudio) { continue; }
+		asset.name = name;
+		asset.path = RESOURCE_FOLDER + file;
+		asset.width = 0;
+		asset.height = 0;
+		asset.pixels = NULL;
+		asset.chunk = NULL;
+		asset.music = NULL;
+		assets.push_back(asset);
+	}
+
+	startTime = chrono::high_resolution_clock::now();
+	nextAsset = 0;
+	int threadCount = min(max(workerCount, 1), (int)assets.size());
+	for (int i = 0; i < threadCount; i++) {
+		workers.push_back(thread([this]() { Decode(); }));
+	}
+	return true;
+}
+
+//each worker claims the next undecoded asset until there are none left
+void AssetManager::Decode() {
+	for (int i = nextAsset++; i < (int)assets.size(); i = nextAsset++) {
+		Asset &asset = assets[i];
+		if (asset.kind == ASSET_IMAGE) {
+			int comp;
+			asset.pixels = stbi_load(asset.path.c_str(), &asset.width, &asset.height, &comp, STBI_rgb_alpha);
+		}
+		else if (asset.kind == ASSET_SOUND) {
+			lock_guard<mutex> lock(audioMutex);
+			asset.chunk = Mix_LoadWAV(asset.path.c_str());
+		}
+		else {
+			lock_guard<mutex> lock(audioMutex);
+			asset.music = Mix_LoadMUS(asset.path.c_str());
+		}
+	}
+}
+
+//waits for the workers; missing images are fatal like they are for the atlas, missing audio just plays nothing
+void AssetManager::Finish() {
+	if (workers.empty()) { return; }
+	for (int i = 0; i < (int)workers.size(); i++) {
+		workers[i].join();
+	}
+	decodeTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startTime).count();
+	workers.clear();
+
+	for (int i = 0; i < (int)assets.size(); i++) {
+		Asset &asset = assets[i];
+		if (asset.kind == ASSET_IMAGE && asset.pixels == NULL) {
+			cout << "Unable to load image " << asset.path << ". Make sure the path is correct\n";
+			assert(false);
+		}
+		else if (asset.kind != ASSET_IMAGE && asset.chunk == NULL && asset.music == NULL) {
+			cout << "Unable to load audio " << asset.path << "\n";
+		}
+	}
+}
+
+AssetManager::Asset *AssetManager::Find(AssetKind kind, const string &name) {
+	for (int i = 0; i < (int)assets.size(); i++) {
+		if (assets[i].kind == kind && assets[i].name == name) { return &assets[i]; }
+	}
+	return NULL;
+}
+
+//hands a decoded image's pixels over to the atlas, which frees them once it has been built
+int AssetManager::AddToAtlas(TextureAtlas &atlas, const string &name) {
+	Asset *asset = Find(ASSET_IMAGE, name);
+	if (asset == NULL || asset->pixels == NULL) {
+		cout << "Image " << name << " is not in the asset manifest\n";
 		assert(false);
 	}
+	int index = atlas.Add(asset->pixels, asset->width, asset->height);
+	asset->pixels = NULL;
+	return index;
+}
+
+Mix_Chunk *AssetManager::Sound(const string &name) {
+	Asset *asset = Find(ASSET_SOUND, name);
+	return (asset != NULL ? asset->chunk : NULL);
+}
+
+Mix_Music *AssetManager::Music(const string &name) {
+	Asset *asset = Find(ASSET_MUSIC, name);
+	return (asset != NULL ? asset->music : NULL);
+}
+
+void AssetManager::Cleanup() {
+	Finish();
+	for (int i = 0; i < (int)assets.size(); i++) {
+		Asset &asset = assets[i];
+		if (asset.pixels != NULL) { stbi_image_free(asset.pixels); }
+		if (asset.chunk != NULL) { Mix_FreeChunk(asset.chunk); }
+		if (asset.music != NULL) { Mix_FreeMusic(asset.music); }
+	}
+	assets.clear();
+}
+
+//a fixed pool of worker threads, each with its own deque of jobs. a worker takes the newest job from its own
+//deque and, once that's empty, steals the oldest from another's. the thread waiting in ParallelFor runs jobs
+//too, so with no workers everything just runs inline. ParallelFor must only be called from one thread at a time
+class JobSystem {
+	public:
+		JobSystem();
+		~JobSystem();
+
+		void Start();
+		void Stop();
+		int ThreadCount() const;
+
+		//calls body(begin, end) on batches of at most batchSize indices covering [0, count), returning once all
+		//of them are done. batches never overlap, so a body that only writes its own indices needs no locking
+		void ParallelFor(int count, int batchSize, const function<void(int, int)> &body);
+
+		int workerCount;
+
+	private:
+		struct Job {
+			const function<void(int, int)> *body;
+			int begin;
+			int end;
+			atomic<int> *remaining;
+		};
+
+		struct WorkQueue {
+			mutex lock;
+			deque<Job> jobs;
+		};
+
+		bool TakeJob(int queueIndex, Job &job);
+		void RunJob(const Job &job);
+		void WorkerLoop(int queueIndex);
+
+		vector<thread> workers;
+		//one per worker, plus a last one for the thread calling ParallelFor
+		vector<WorkQueue*> queues;
+		mutex sleepLock;
+		condition_variable wake;
+		atomic<int> queuedJobs;
+		bool stopping;
+};
+
+JobSystem::JobSystem() {
+	//the main thread is the last pair of hands
+	unsigned int cores = thread::hardware_concurrency();
+	workerCount = (cores > 1 ? (int)cores - 1 : 0);
+	queuedJobs = 0;
+	stopping = false;
+}
+
+JobSystem::~JobSystem() {
+	Stop();
+}
+
+void JobSystem::Start() {
+	Stop();
+	stopping = false;
+	int threadCount = max(workerCount, 0);
+	for (int i = 0; i <= threadCount; i++) {
+		queues.push_back(new WorkQueue());
+	}
+	for (int i = 0; i < threadCount; i++) {
+		workers.push_back(thread([this, i]() { WorkerLoop(i); }));
+	}
+}
+
+void JobSystem::Stop() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (int i = 0; i < (int)workers.size(); i++) {
+		workers[i].join();
+	}
+	workers.clear();
+	for (int i = 0; i < (int)queues.size(); i++) {
+		delete queues[i];
+	}
+	queues.clear();
+	queuedJobs = 0;
+}
+
+int JobSystem::ThreadCount() const {
+	return (int)workers.size() + 1;
+}
+
+bool JobSystem::TakeJob(int queueIndex, Job &job) {
+	WorkQueue &own = *queues[queueIndex];
+	{
+		lock_guard<mutex> guard(own.lock);
+		if (!own.jobs.empty()) {
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			queuedJobs--;
+			return true;
+		}
+	}
 
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+	//steal starting from the next queue along, so idle threads don't all pile onto the same one
+	int queueCount = (int)queues.size();
+	for (int i = 1; i < queueCount; i++) {
+		WorkQueue &victim = *queues[(queueIndex + i) % queueCount];
+		lock_guard<mutex> guard(victim.lock);
+		if (!victim.jobs.empty()) {
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			queuedJobs--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::RunJob(const Job &job) {
+	(*job.body)(job.begin, job.end);
+	(*job.remaining)--;
+}
+
+void JobSystem::WorkerLoop(int queueIndex) {
+	Job job;
+	while (true) {
+		if (TakeJob(queueIndex, job)) {
+			RunJob(job);
+			continue;
+		}
+		unique_lock<mutex> guard(sleepLock);
+		wake.wait(guard, [this]() { return stopping || queuedJobs > 0; });
+		if (stopping) { return; }
+	}
+}
+
+void JobSystem::ParallelFor(int count, int batchSize, const function<void(int, int)> &body) {
+	batchSize = max(batchSize, 1);
+	if (workers.empty() || count <= batchSize) {
+		if (count > 0) { body(0, count); }
+		return;
+	}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//deal the batches out round-robin so every thread starts on its own share before it has to steal
+	atomic<int> remaining((count + batchSize - 1) / batchSize);
+	int queueCount = (int)queues.size();
+	int queueIndex = 0;
+	for (int begin = 0; begin < count; begin += batchSize) {
+		Job job = { &body, begin, min(begin + batchSize, count), &remaining };
+		{
+			lock_guard<mutex> guard(queues[queueIndex]->lock);
+			queues[queueIndex]->jobs.push_back(job);
+		}
+		queuedJobs++;
+		queueIndex = (queueIndex + 1) % queueCount;
+	}
+	//taking the lock orders the new jobs before any worker's check, so none of them sleeps through the notify
+	{
+		lock_guard<mutex> guard(sleepLock);
+	}
+	wake.notify_all();
 
-	stbi_image_free(image);
-	return retTexture;
+	//work through our own share and steal until every batch is done; the last few may still be running elsewhere
+	Job job;
+	while (remaining > 0) {
+		if (TakeJob(queueCount - 1, job)) {
+			RunJob(job);
+		}
+		else {
+			this_thread::yield();
+		}
+	}
 }
 
 float lastFrameTicks = 0.0f;
 
-GLuint fontTexture, keyTexture, tilesTexture, playerTexture, emptyTexture, beeTexture;
+TextureAtlas spriteAtlas;
+AssetManager assets;
+JobSystem jobs;
+AtlasRegion fontRegion, keyRegion, tilesRegion, playerRegion, emptyRegion, beeRegion;
 
 enum gameMode {MODE_START, MODE_OUTDOORS, MODE_STORE, MODE_EXIT, MODE_GAMEOVER, MODE_VICTORY};
 gameMode mode;
@@ -372,18 +1750,284 @@ Mix_Music *bgm_outdoors, *bgm_store, *bgm_exit;
 #define TILE_SIZE 0.2f
 #define SPRITE_COUNT_X 14
 #define SPRITE_COUNT_Y 14
-#define NUM_SOLIDS 7
 
-vector<float> level_vertexData;
-vector<float> level_texCoordData;
-vector<float> overlay_vertexData;
-vector<float> overlay_texCoordData;
-vector<float> temporary_vertexData;
-vector<float> temporary_texCoordData;
+//tile indices fit in 16 bits for every tileset we use; widen this if that stops being true
+typedef uint16_t TileIndex;
+
+//one layer of tile indices in a single contiguous row-major buffer
+class TileLayer {
+public:
+	TileLayer();
+
+	void Resize(int width_in, int height_in);
+	void Clear();
+
+	TileIndex Get(int x, int y) const;
+	TileIndex GetUnchecked(int x, int y) const;
+	void Set(int x, int y, TileIndex value);
+
+	int width;
+	int height;
+	vector<TileIndex> tiles;
+};
+
+TileLayer::TileLayer() {
+	width = 0;
+	height = 0;
+}
+
+void TileLayer::Resize(int width_in, int height_in) {
+	width = width_in;
+	height = height_in;
+	tiles.assign(width * height, 0);
+}
+
+void TileLayer::Clear() {
+	width = 0;
+	height = 0;
+	tiles.clear();
+}
+
+//anything outside the layer reads as the empty tile
+TileIndex TileLayer::Get(int x, int y) const {
+	if (x < 0 || y < 0 || x >= width || y >= height) { return 0; }
+	return tiles[y * width + x];
+}
+
+TileIndex TileLayer::GetUnchecked(int x, int y) const {
+	return tiles[y * width + x];
+}
+
+void TileLayer::Set(int x, int y, TileIndex value) {
+	tiles[y * width + x] = value;
+}
+
+//per-tile flags for a tileset, read from the custom properties in its Tiled .tsx file
+class TilesetProperties {
+public:
+	bool Load(const string &filePath);
+	bool IsSolid(TileIndex tile) const;
+
+	vector<bool> solid;
+};
+
+//bool properties are written by Tiled as <tile id="N"><properties><property name="solid" type="bool" value="true"/>
+bool TilesetProperties::Load(const string &filePath) {
+	ifstream infile(filePath);
+	if (!infile) { return false; }
+	stringstream buffer;
+	buffer << infile.rdbuf();
+	string xml = buffer.str();
+
+	solid.clear();
+	size_t tileStart = xml.find("<tile ");
+	while (tileStart != string::npos) {
+		size_t tileEnd = xml.find("</tile>", tileStart);
+		size_t idStart = xml.find("id=\"", tileStart);
+		if (tileEnd == string::npos || idStart == string::npos || idStart > tileEnd) { break; }
+		int id = atoi(xml.c_str() + idStart + 4);
+
+		string tileXML = xml.substr(tileStart, tileEnd - tileStart);
+		size_t property = tileXML.find("name=\"solid\"");
+		if (property != string::npos && tileXML.find("value=\"true\"", property) != string::npos) {
+			if (id >= (int)solid.size()) { solid.resize(id + 1, false); }
+			solid[id] = true;
+		}
+		tileStart = xml.find("<tile ", tileEnd);
+	}
+	return true;
+}
+
+bool TilesetProperties::IsSolid(TileIndex tile) const {
+	return tile < solid.size() && solid[tile];
+}
+
+//one bit per cell of a layer, set where the tile is solid, so a collision probe is a single bit fetch
+class CollisionBitmap {
+public:
+	CollisionBitmap();
+
+	void Build(const TileLayer &layer, const TilesetProperties &tileset);
+	bool IsSolid(int x, int y) const;
+
+	int width;
+	int height;
+	vector<uint32_t> bits;
+};
+
+CollisionBitmap::CollisionBitmap() {
+	width = 0;
+	height = 0;
+}
+
+void CollisionBitmap::Build(const TileLayer &layer, const TilesetProperties &tileset) {
+	width = layer.width;
+	height = layer.height;
+	bits.assign((width * height + 31) / 32, 0);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			if (tileset.IsSolid(layer.GetUnchecked(x, y))) {
+				int cell = y * width + x;
+				bits[cell >> 5] |= (1u << (cell & 31));
+			}
+		}
+	}
+}
+
+//anything outside the map is open
+bool CollisionBitmap::IsSolid(int x, int y) const {
+	if (x < 0 || y < 0 || x >= width || y >= height) { return false; }
+	int cell = y * width + x;
+	return (bits[cell >> 5] >> (cell & 31)) & 1u;
+}
+
+#define CHUNK_SIZE 16
+#define VIEW_HALF_WIDTH 1.777f
+#define VIEW_HALF_HEIGHT 1.0f
+
+//static geometry for a CHUNK_SIZE x CHUNK_SIZE block of tiles, uploaded to the GPU once per level
+class TileChunk {
+public:
+	TileChunk();
+
+	void Upload(const vector<float> &vertexData, const vector<float> &texCoordData);
+	void Draw(ShaderProgram &program);
+	void Cleanup();
+
+	GLuint bufferID;
+	int vertexCount;
+};
+
+//chunked geometry for one tile layer, still in client memory so it can be built off the main thread
+class TileLayerGeometry {
+public:
+	TileLayerGeometry();
+
+	void Build(const TileLayer &layer);
+	void Clear();
+
+	vector<vector<float>> chunkVertexData;
+	vector<vector<float>> chunkTexCoordData;
+	int chunksWide;
+	int chunksHigh;
+};
+
+//one tile layer split into a grid of chunks so only the ones under the camera get drawn
+class TileLayerBuffer {
+public:
+	TileLayerBuffer();
+
+	void Upload(const TileLayerGeometry &geometry);
+	void Draw(ShaderProgram &program, float left, float right, float bottom, float top);
+	void Cleanup();
+
+	vector<TileChunk> chunks;
+	int chunksWide;
+	int chunksHigh;
+};
+
+TileChunk::TileChunk() {
+	bufferID = 0;
+	vertexCount = 0;
+}
+
+void TileChunk::Upload(const vector<float> &vertexData, const vector<float> &texCoordData) {
+	Cleanup();
+	vertexCount = (int)vertexData.size() / 2;
+	if (vertexCount == 0) { return; }
+
+	//interleave as x, y, u, v so each chunk is a single buffer
+	vector<float> interleaved;
+	interleaved.reserve(vertexCount * 4);
+	for (int i = 0; i < vertexCount; i++) {
+		interleaved.insert(interleaved.end(), {
+			vertexData[i * 2], vertexData[i * 2 + 1],
+			texCoordData[i * 2], texCoordData[i * 2 + 1]
+			});
+	}
+
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+	glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(float), interleaved.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TileChunk::Draw(ShaderProgram &program) {
+	if (vertexCount == 0) { return; }
+
+	glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)0);
+	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+	glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+}
+
+void TileChunk::Cleanup() {
+	if (bufferID != 0) {
+		glDeleteBuffers(1, &bufferID);
+		bufferID = 0;
+	}
+	vertexCount = 0;
+}
+
+TileLayerBuffer::TileLayerBuffer() {
+	chunksWide = 0;
+	chunksHigh = 0;
+}
+
+void TileLayerBuffer::Upload(const TileLayerGeometry &geometry) {
+	Cleanup();
+	chunksWide = geometry.chunksWide;
+	chunksHigh = geometry.chunksHigh;
+	chunks.resize(chunksWide * chunksHigh);
+	for (int i = 0; i < (int)chunks.size(); i++) {
+		chunks[i].Upload(geometry.chunkVertexData[i], geometry.chunkTexCoordData[i]);
+	}
+}
+
+void TileLayerBuffer::Draw(ShaderProgram &program, float left, float right, float bottom, float top) {
+	if (chunks.empty()) { return; }
+
+	//chunks form a regular grid, so the visible range falls straight out of the view rect
+	float chunkWorldSize = CHUNK_SIZE * TILE_SIZE;
+	int firstCol = (int)floor(left / chunkWorldSize);
+	int lastCol = (int)floor(right / chunkWorldSize);
+	int firstRow = (int)floor(-top / chunkWorldSize);
+	int lastRow = (int)floor(-bottom / chunkWorldSize);
+	firstCol = (firstCol < 0 ? 0 : firstCol);
+	firstRow = (firstRow < 0 ? 0 : firstRow);
+	lastCol = (lastCol >= chunksWide ? chunksWide - 1 : lastCol);
+	lastRow = (lastRow >= chunksHigh ? chunksHigh - 1 : lastRow);
+
+	glEnableVertexAttribArray(program.positionAttribute);
+	glEnableVertexAttribArray(program.texCoordAttribute);
+	for (int row = firstRow; row <= lastRow; row++) {
+		for (int col = firstCol; col <= lastCol; col++) {
+			chunks[row * chunksWide + col].Draw(program);
+		}
+	}
+	glDisableVertexAttribArray(program.positionAttribute);
+	glDisableVertexAttribArray(program.texCoordAttribute);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TileLayerBuffer::Cleanup() {
+	for (int i = 0; i < (int)chunks.size(); i++) {
+		chunks[i].Cleanup();
+	}
+	chunks.clear();
+	chunksWide = 0;
+	chunksHigh = 0;
+}
+
+TileLayerBuffer levelBuffer, overlayBuffer, temporaryBuffer;
+SpriteBatch spriteBatch;
+QuadRenderer quadRenderer;
 
-Entity Player, Key, Door, PointOfInterest, Enemy;
+World world;
+EntityID playerEntity = NO_ENTITY;
 
-vector<ParticleEmitter> ParticleEmitters;
+#define MAX_EMITTERS 16
+ObjectPool<ParticleEmitter> ParticleEmitters(MAX_EMITTERS);
 
 bool showOverlay = true;
 bool showTemporary = true;
@@ -393,24 +2037,103 @@ bool showFlavorText = false;
 string flavorText;
 bool ribbited = false;
 
-int mapWidth, mapHeight;
-unsigned int** levelData, **overlayData, **temporaryData;
-unsigned int solid_indices[NUM_SOLIDS] = {
-	114, 100, 86, 72, 120, 177, 64
-}; 
+glm::vec3 clearColor(0.05f, 0.46f, 0.8f);
+
+//key state Update reads; NULL means the live SDL keyboard
+const Uint8 *inputKeys = NULL;
+
+bool showProfiler = false;
+
+//an object layer entry, in tile coordinates
+class MapEntity {
+public:
+	string type;
+	int x;
+	int y;
+};
+
+//everything read from a map file, plus its tile geometry
+class LevelMap {
+public:
+	LevelMap();
+
+	void Allocate(int width_in, int height_in);
+	void Free();
+	void BuildGeometry();
+	void BuildCollision(const TilesetProperties &tileset);
+
+	int width;
+	int height;
+	TileLayer levelData;
+	TileLayer overlayData;
+	TileLayer temporaryData;
+	vector<MapEntity> entities;
+	CollisionBitmap collision;
+
+	TileLayerGeometry levelGeometry;
+	TileLayerGeometry overlayGeometry;
+	TileLayerGeometry temporaryGeometry;
+};
+
+//loads and builds the next level on a background thread so level transitions don't hitch
+class LevelLoader {
+public:
+	LevelLoader();
+	~LevelLoader();
+
+	void Start(const char *filename_in);
+	LevelMap *Take(const string &filename_in);
+	void Cancel();
+
+	string filename;
+	thread worker;
+	LevelMap *result;
+};
+
+LevelMap *currentMap = NULL;
+string currentMapFile;
+LevelLoader levelLoader;
+TilesetProperties tileProperties;
+
+//bumped by SetupLevel and ExitLevel. the renderer keeps its tile buffers for one generation and swaps
+//them out when a snapshot of a newer one arrives
+int levelGeneration = 0;
 
 glm::mat4 projectionMatrix = glm::mat4(1.0f);
 glm::mat4 viewMatrix = glm::mat4(1.0f);
 
 float maxCameraX, maxCameraY, minCameraX, minCameraY;
 
-ShaderProgram program, pointProgram;
+ShaderProgram program, quadProgram;
 
 //Tilemap/Level Generation
-bool readHeader(ifstream &stream) {
+LevelMap::LevelMap() {
+	width = 0;
+	height = 0;
+}
+
+void LevelMap::Allocate(int width_in, int height_in) {
+	Free();
+	width = width_in;
+	height = height_in;
+	levelData.Resize(width, height);
+	overlayData.Resize(width, height);
+	temporaryData.Resize(width, height);
+}
+
+void LevelMap::Free() {
+	width = 0;
+	height = 0;
+	levelData.Clear();
+	overlayData.Clear();
+	temporaryData.Clear();
+	entities.clear();
+}
+
+bool readHeader(ifstream &stream, LevelMap &map) {
 	string line;
-	mapWidth = -1;
-	mapHeight = -1;
+	int mapWidth = -1;
+	int mapHeight = -1;
 	while (getline(stream, line)) {
 		if (line == "") { break; }
 		istringstream sStream(line);
@@ -428,39 +2151,32 @@ bool readHeader(ifstream &stream) {
 		return false;
 	}
 	else { // allocate our map data
-		levelData = new unsigned int*[mapHeight];
-		overlayData = new unsigned int*[mapHeight];
-		temporaryData = new unsigned int*[mapHeight];
-		for (int i = 0; i < mapHeight; ++i) {
-			levelData[i] = new unsigned int[mapWidth];
-			overlayData[i] = new unsigned int[mapWidth];
-			temporaryData[i] = new unsigned int[mapWidth];
-		}
+		map.Allocate(mapWidth, mapHeight);
 		return true;
 	}
 }
 
-void populateLevelArray(ifstream &stream, unsigned int** &levelArray) {
+void populateLevelArray(ifstream &stream, TileLayer &layer) {
 	string line;
 	getline(stream, line);
-	for (int y = 0; y < mapHeight; y++) {
+	for (int y = 0; y < layer.height; y++) {
 		getline(stream, line);
 		istringstream lineStream(line);
 		string tile;
-		for (int x = 0; x < mapWidth; x++) {
+		for (int x = 0; x < layer.width; x++) {
 			getline(lineStream, tile, ',');
 			unsigned int val = (unsigned int)atoi(tile.c_str());
 			if (val > 0) {
-				levelArray[y][x] = val - 1;
+				layer.Set(x, y, (TileIndex)(val - 1));
 			}
 			else {
-				levelArray[y][x] = 0;
+				layer.Set(x, y, 0);
 			}
 		}
 	}
 }
 
-bool readLayerData(ifstream &stream) {
+bool readLayerData(ifstream &stream, LevelMap &map) {
 	string line;
 	while (getline(stream, line)) {
 		if (line == "") { break; }
@@ -470,92 +2186,59 @@ bool readLayerData(ifstream &stream) {
 		getline(sStream, value);
 		if (key == "type") {
 			if (value == "base") {
-				populateLevelArray(stream, levelData);
+				populateLevelArray(stream, map.levelData);
 			}
 			else if (value == "overlay") {
-				populateLevelArray(stream, overlayData);
+				populateLevelArray(stream, map.overlayData);
 			}
 			else if (value == "temporary") {
-				populateLevelArray(stream, temporaryData);
+				populateLevelArray(stream, map.temporaryData);
 			}
 		}
 	}
 	return true;
 }
 
+//the frog's idle animation, as u/v pairs into its sheet
+const float playerFrames[] = {
+	0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
+	0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
+	0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
+	0.0f, 0.0f, 0.5f, 0.0f, 0.5f, 0.5f, 0.5f, 0.0f
+};
+const AnimationClip playerClip = { playerFrames, (int)(sizeof(playerFrames) / sizeof(float) / 2) };
+
 void placeEntity(string type, float placeX, float placeY) {
+	//everything but the player is centered on its tile
+	glm::vec3 tileCenter(placeX + 0.5f * TILE_SIZE, placeY, 0.0f);
 	if (type == "player") {
-		Player.entityType = ENTITY_PLAYER;
-		Player.position = glm::vec3(placeX, placeY, 0.0f);
-		Player.isStatic = false;
-		Player.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		Player.animFPS = 1.0f;
-		Player.elapsedSinceLastAnim = 0.0f;
-		Player.sprite = SheetSprite(playerTexture, 0.5f, 0.5f, 1.0f);
-		Player.size = glm::vec3(0.165714f, 0.111429f, 1.0f);
-		Player.sprite.indices.insert(Player.sprite.indices.end(), {
-			0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
-			0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
-			0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
-			0.0f, 0.0f, 0.5f, 0.0f, 0.5f, 0.5f, 0.5f, 0.0f
-		});
-		Player.animFPS = 4.0f;
-		Player.facingRight = true;
+		EntityID entity = world.Create(COMPONENT_SPRITE | COMPONENT_BODY | COMPONENT_ANIMATION | COMPONENT_PLAYER,
+			glm::vec3(placeX, placeY, 0.0f), glm::vec3(0.165714f, 0.111429f, 1.0f));
+		world.sprite[entity] = SheetSprite(playerRegion, 0.5f, 0.5f, 1.0f);
+		world.gravity[entity] = -2.0f;
+		world.clip[entity] = &playerClip;
+		world.animFPS[entity] = 4.0f;
+		playerEntity = entity;
 	}
 	else if (type == "key") {
-		Key.entityType = ENTITY_KEY;
-		Key.position = glm::vec3(placeX + 0.5f * TILE_SIZE, placeY, 0.0f);
-		Key.isStatic = false;
-		Key.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		Key.animFPS = 1.0f;
-		Key.elapsedSinceLastAnim = 0.0f;
-		Key.sprite = SheetSprite(keyTexture, 1.0f, 1.0f, 1.0f);
-		Key.size = glm::vec3(0.1714f, 0.16f, 1.0f);
-		Key.sprite.indices.insert(Key.sprite.indices.end(), { 0.0f, 0.0f });
-		Key.facingRight = true;
+		EntityID entity = world.Create(COMPONENT_SPRITE | COMPONENT_BODY | COMPONENT_PICKUP, tileCenter, glm::vec3(0.1714f, 0.16f, 1.0f));
+		world.sprite[entity] = SheetSprite(keyRegion, 1.0f, 1.0f, 1.0f);
+		world.gravity[entity] = -0.7f;
 	}
 	else if (type == "door") {
-		Door.entityType = ENTITY_DOOR;
-		Door.position = glm::vec3(placeX + 0.5f * TILE_SIZE, placeY, 0.0f);
-		Door.isStatic = true;
-		Door.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		Door.animFPS = 1.0f;
-		Door.elapsedSinceLastAnim = 0.0f;
-		Door.sprite = SheetSprite(emptyTexture, 1.0f, 1.0f, 1.0f);
-		Door.size = glm::vec3(0.2f, 0.2f, 1.0f);
-		Door.sprite.indices.insert(Door.sprite.indices.end(), { 0.0f, 0.0f });
-		Door.isLocked = true;
-		Door.facingRight = true;
+		EntityID entity = world.Create(COMPONENT_DOOR, tileCenter, glm::vec3(0.2f, 0.2f, 1.0f));
+		world.isLocked[entity] = true;
 	}
 	else if (type == "POI") {
-		PointOfInterest.entityType = ENTITY_POI;
-		PointOfInterest.position = glm::vec3(placeX + 0.5f * TILE_SIZE, placeY, 0.0f);
-		PointOfInterest.isStatic = true;
-		PointOfInterest.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		PointOfInterest.animFPS = 1.0f;
-		PointOfInterest.elapsedSinceLastAnim = 0.0f;
-		PointOfInterest.sprite = SheetSprite(emptyTexture, 1.0f, 1.0f, 1.0f);
-		PointOfInterest.size = glm::vec3(0.3, 0.3f, 1.0f);
-		PointOfInterest.sprite.indices.insert(PointOfInterest.sprite.indices.end(), { 0.0f, 0.0f });
-		PointOfInterest.facingRight = true;
+		world.Create(COMPONENT_SIGN, tileCenter, glm::vec3(0.3f, 0.3f, 1.0f));
 	}
 	else if (type == "enemy") {
-		Enemy.entityType = ENTITY_ENEMY;
-		Enemy.position = glm::vec3(placeX + 0.5f * TILE_SIZE, placeY, 0.0f);
-		Enemy.isStatic = false;
-		Enemy.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		Enemy.animFPS = 1.0f;
-		Enemy.elapsedSinceLastAnim = 0.0f;
-		Enemy.sprite = SheetSprite(beeTexture, 1.0f, 1.0f, 1.0f);
-		Enemy.size = glm::vec3(0.16, 0.137f, 1.0f);
-		Enemy.sprite.indices.insert(Enemy.sprite.indices.end(), { 0.0f, 0.0f });
-		Enemy.facingRight = true;
-		Enemy.isAngry = false;
-		Enemy.resetPos = glm::vec3(placeX + 0.5f * TILE_SIZE, placeY, 0.0f);
-	}
-}
-
-bool readEntityData(ifstream &stream) {
+		EntityID entity = world.Create(COMPONENT_SPRITE | COMPONENT_CHASER, tileCenter, glm::vec3(0.16f, 0.137f, 1.0f));
+		world.sprite[entity] = SheetSprite(beeRegion, 1.0f, 1.0f, 1.0f);
+	}
+}
+
+bool readEntityData(ifstream &stream, vector<MapEntity> &entities) {
 	string line;
 	string type;
 	while (getline(stream, line)) {
@@ -573,72 +2256,625 @@ bool readEntityData(ifstream &stream) {
 			getline(lineStream, xPosition, ',');
 			getline(lineStream, yPosition, ',');
 
-			float placeX = atoi(xPosition.c_str()) * TILE_SIZE;
-			float placeY = atoi(yPosition.c_str()) * -TILE_SIZE;
-			
-			placeEntity(type, placeX, placeY);
+			MapEntity entity;
+			entity.type = type;
+			entity.x = atoi(xPosition.c_str());
+			entity.y = atoi(yPosition.c_str());
+			entities.push_back(entity);
 		}
 	}
 	return true;
 }
 
-void populateLevelVector(vector<float> &levelVertexVector, vector<float> &levelTexCoordVector, unsigned int** &levelArray) {
-	for (int y = 0; y < mapHeight; y++) {
-		for (int x = 0; x < mapWidth; x++) {
-			if (levelArray[y][x] != 0) {
-				float u = (float)(((int)levelArray[y][x]) % SPRITE_COUNT_X) / (float)SPRITE_COUNT_X;
-				float v = (float)(((int)levelArray[y][x]) / SPRITE_COUNT_X) / (float)SPRITE_COUNT_Y;
+//Precompiled binary maps
+//layout: MapFileHeader, then base/overlay/temporary layers as width*height uint16 tiles
+//(padded to 4 bytes), then entityCount MapFileEntity records
+#define MAP_FILE_MAGIC 0x46424254
+#define MAP_FILE_VERSION 1
+#define MAP_FILE_LAYERS 3
+#define MAP_ENTITY_TYPE_LENGTH 16
+//largest width or height a precompiled map may claim; anything bigger is taken as a corrupt file
+#define MAP_FILE_MAX_SIDE 4096
+
+struct MapFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t layerCount;
+	uint32_t entityCount;
+};
 
-				//manually putting these in b/c of annoying padding in the spritesheet
-				float spriteWidth = 0.069444444f;
-				float spriteHeight = 0.069444444f;
+struct MapFileEntity {
+	char type[MAP_ENTITY_TYPE_LENGTH];
+	int32_t x;
+	int32_t y;
+};
 
-				levelVertexVector.insert(levelVertexVector.end(), {
-					TILE_SIZE * x, -TILE_SIZE * y,
-					TILE_SIZE * x, (-TILE_SIZE * y) - TILE_SIZE,
-					(TILE_SIZE * x) + TILE_SIZE, (-TILE_SIZE * y) - TILE_SIZE,
-					TILE_SIZE * x, -TILE_SIZE * y,
-					(TILE_SIZE * x) + TILE_SIZE, (-TILE_SIZE * y) - TILE_SIZE,
-					(TILE_SIZE * x) + TILE_SIZE, -TILE_SIZE * y
-					});
-				levelTexCoordVector.insert(levelTexCoordVector.end(), {
-					u, v,
-					u, v + (spriteHeight),
-					u + spriteWidth, v + (spriteHeight),
-					u, v,
-					u + spriteWidth, v + (spriteHeight),
-					u + spriteWidth, v
-					});
+//read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const string &filePath);
+	void Close();
+
+	const unsigned char *data;
+	size_t size;
+#ifdef _WINDOWS
+	HANDLE fileHandle;
+	HANDLE mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
+
+MappedFile::MappedFile() {
+	data = NULL;
+	size = 0;
+#ifdef _WINDOWS
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#else
+	fileDescriptor = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const string &filePath) {
+	Close();
+#ifdef _WINDOWS
+	fileHandle = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) { return false; }
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(fileHandle, &fileSize);
+	size = (size_t)fileSize.QuadPart;
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL) { Close(); return false; }
+	data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+	fileDescriptor = open(filePath.c_str(), O_RDONLY);
+	if (fileDescriptor == -1) { return false; }
+	struct stat fileInfo;
+	fstat(fileDescriptor, &fileInfo);
+	size = (size_t)fileInfo.st_size;
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	data = (mapping == MAP_FAILED ? NULL : (const unsigned char*)mapping);
+#endif
+	if (data == NULL) { Close(); return false; }
+	return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WINDOWS
+	if (data != NULL) { UnmapViewOfFile(data); }
+	if (mappingHandle != NULL) { CloseHandle(mappingHandle); }
+	if (fileHandle != INVALID_HANDLE_VALUE) { CloseHandle(fileHandle); }
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (data != NULL) { munmap((void*)data, size); }
+	if (fileDescriptor != -1) { close(fileDescriptor); }
+	fileDescriptor = -1;
+#endif
+	data = NULL;
+	size = 0;
+}
+
+string binaryMapPath(const string &textPath) {
+	size_t dot = textPath.rfind('.');
+	return (dot == string::npos ? textPath : textPath.substr(0, dot)) + ".tbm";
+}
+
+//last modification in nanoseconds. st_mtime only has whole seconds, which can't order a map saved in the
+//same second its precompiled copy was written
+bool fileModifiedTime(const string &filePath, long long &modified) {
+#ifdef _WINDOWS
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(filePath.c_str(), GetFileExInfoStandard, &info)) { return false; }
+	//FILETIMEs count 100ns ticks
+	modified = (((long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+	struct stat info;
+	if (stat(filePath.c_str(), &info) != 0) { return false; }
+#ifdef __APPLE__
+	modified = (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+	modified = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+//strictly newer, so a tie goes to whoever calls this rebuilding from the other file
+bool isFileNewer(const string &filePath, const string &otherPath) {
+	long long fileModified, otherModified;
+	if (!fileModifiedTime(filePath, fileModified)) { return false; }
+	if (!fileModifiedTime(otherPath, otherModified)) { return true; }
+	return fileModified > otherModified;
+}
+
+//seconds between modification time checks where inotify isn't available
+#define FILE_WATCH_INTERVAL 0.25f
+
+//reports files that have been saved since the last Poll. uses inotify on Linux, so polling costs one
+//non-blocking read; elsewhere it compares modification times every FILE_WATCH_INTERVAL
+class FileWatcher {
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	void Watch(const string &filePath);
+	bool Poll(vector<string> &changed);
+
+	struct WatchedFile {
+		string path;
+		string directory;
+		string name;
+		//nanoseconds, as fileModifiedTime gives it; 0 while the file can't be found
+		long long modified;
+	};
+
+	vector<WatchedFile> files;
+#ifdef __linux__
+	int inotifyDescriptor;
+	vector<int> directoryWatches;
+	vector<string> directories;
+#else
+	chrono::high_resolution_clock::time_point lastCheck;
+#endif
+};
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+	inotifyDescriptor = -1;
+#else
+	lastCheck = chrono::high_resolution_clock::now();
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (inotifyDescriptor != -1) { close(inotifyDescriptor); }
+#endif
+}
+
+void FileWatcher::Watch(const string &filePath) {
+	WatchedFile file;
+	size_t slash = filePath.rfind('/');
+	file.path = filePath;
+	file.directory = (slash == string::npos ? "." : filePath.substr(0, slash));
+	file.name = (slash == string::npos ? filePath : filePath.substr(slash + 1));
+	if (!fileModifiedTime(filePath, file.modified)) { file.modified = 0; }
+	files.push_back(file);
+
+#ifdef __linux__
+	//watch directories rather than files, since editors often save by writing a new file and renaming it over the old one
+	if (inotifyDescriptor == -1) {
+		inotifyDescriptor = inotify_init1(IN_NONBLOCK);
+		if (inotifyDescriptor == -1) { return; }
+	}
+	if (find(directories.begin(), directories.end(), file.directory) == directories.end()) {
+		directoryWatches.push_back(inotify_add_watch(inotifyDescriptor, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO));
+		directories.push_back(file.directory);
+	}
+#endif
+}
+
+bool FileWatcher::Poll(vector<string> &changed) {
+	changed.clear();
+#ifdef __linux__
+	if (inotifyDescriptor == -1) { return false; }
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(inotifyDescriptor, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t offset = 0; offset < length;) {
+			const inotify_event *event = (const inotify_event*)(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+			if (event->len == 0) { continue; }
+			for (int i = 0; i < (int)files.size(); i++) {
+				if (files[i].name != event->name) { continue; }
+				for (int j = 0; j < (int)directoryWatches.size(); j++) {
+					if (directoryWatches[j] == event->wd && directories[j] == files[i].directory &&
+						find(changed.begin(), changed.end(), files[i].path) == changed.end()) {
+						changed.push_back(files[i].path);
+					}
+				}
 			}
 		}
 	}
+#else
+	chrono::high_resolution_clock::time_point now = chrono::high_resolution_clock::now();
+	if (chrono::duration<float>(now - lastCheck).count() < FILE_WATCH_INTERVAL) { return false; }
+	lastCheck = now;
+	for (int i = 0; i < (int)files.size(); i++) {
+		long long modified;
+		if (!fileModifiedTime(files[i].path, modified)) { modified = 0; }
+		if (modified != files[i].modified) {
+			files[i].modified = modified;
+			changed.push_back(files[i].path);
+		}
+	}
+#endif
+	return !changed.empty();
 }
 
-void SetupLevel(string filename, Mix_Music* &music) {
-	//Setup the Level/Objects
-	ifstream infile(RESOURCE_FOLDER+filename);
+//parses a Tiled text export into a level map
+bool loadTextMap(const string &filePath, LevelMap &map) {
+	ifstream infile(filePath);
+	if (!infile) { return false; }
+	bool hasHeader = false;
 	string line;
 	while (getline(infile, line)) {
 		if (line == "[header]") {
-			(!readHeader(infile));
+			hasHeader = readHeader(infile, map);
 		}
-		else if (line == "[layer]") {
-			readLayerData(infile);
+		else if (line == "[layer]" && hasHeader) {
+			readLayerData(infile, map);
 		}
 		else if (line == "[objectLayer]") {
-			readEntityData(infile);
+			readEntityData(infile, map.entities);
 		}
 	}
+	return hasHeader;
+}
 
-	populateLevelVector(level_vertexData, level_texCoordData, levelData);
-	populateLevelVector(overlay_vertexData, overlay_texCoordData, overlayData);
-	populateLevelVector(temporary_vertexData, temporary_texCoordData, temporaryData);
+//maps a precompiled map and copies its tiles straight into the level arrays
+bool loadBinaryMap(const string &filePath, LevelMap &map) {
+	MappedFile file;
+	if (!file.Open(filePath) || file.size < sizeof(MapFileHeader)) { return false; }
 
-	//determine Camera Extremes
+	MapFileHeader header;
+	memcpy(&header, file.data, sizeof(header));
+	if (header.magic != MAP_FILE_MAGIC || header.version != MAP_FILE_VERSION || header.layerCount != MAP_FILE_LAYERS) {
+		return false;
+	}
+	if (header.width == 0 || header.height == 0 || header.width > MAP_FILE_MAX_SIDE || header.height > MAP_FILE_MAX_SIDE) {
+		return false;
+	}
+	size_t layerBytes = (((size_t)header.width * header.height * sizeof(uint16_t)) + 3) & ~(size_t)3;
+	size_t entityOffset = sizeof(MapFileHeader) + MAP_FILE_LAYERS * layerBytes;
+	//divided rather than multiplied, so a huge entityCount can't wrap past the check
+	if (file.size < entityOffset || header.entityCount > (file.size - entityOffset) / sizeof(MapFileEntity)) { return false; }
+
+	map.Allocate((int)header.width, (int)header.height);
+
+	TileLayer *layers[MAP_FILE_LAYERS] = { &map.levelData, &map.overlayData, &map.temporaryData };
+	for (int layer = 0; layer < MAP_FILE_LAYERS; layer++) {
+		const unsigned char *tiles = file.data + sizeof(MapFileHeader) + layer * layerBytes;
+		if (sizeof(TileIndex) == sizeof(uint16_t)) {
+			memcpy(layers[layer]->tiles.data(), tiles, map.width * map.height * sizeof(uint16_t));
+		}
+		else {
+			for (int i = 0; i < map.width * map.height; i++) {
+				layers[layer]->tiles[i] = ((const uint16_t*)tiles)[i];
+			}
+		}
+	}
+
+	const MapFileEntity *fileEntities = (const MapFileEntity*)(file.data + entityOffset);
+	for (uint32_t i = 0; i < header.entityCount; i++) {
+		MapEntity entity;
+		entity.type = string(fileEntities[i].type, strnlen(fileEntities[i].type, MAP_ENTITY_TYPE_LENGTH));
+		entity.x = fileEntities[i].x;
+		entity.y = fileEntities[i].y;
+		map.entities.push_back(entity);
+	}
+	return true;
+}
+
+//moves a finished file over another in one step, so nobody opening the target sees it half written
+bool replaceFile(const string &fromPath, const string &toPath) {
+#ifdef _WINDOWS
+	return MoveFileExA(fromPath.c_str(), toPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	//a reader that already has the old file mapped keeps it until it unmaps
+	return rename(fromPath.c_str(), toPath.c_str()) == 0;
+#endif
+}
+
+//writes a level map's arrays and entities as a precompiled map, into a temporary file that then replaces
+//filePath. fails without writing anything if an entity type doesn't fit the fixed-size field
+bool writeBinaryMap(const string &filePath, const LevelMap &map) {
+	for (int i = 0; i < (int)map.entities.size(); i++) {
+		if (map.entities[i].type.size() > MAP_ENTITY_TYPE_LENGTH) {
+			cout << "Entity type " << map.entities[i].type << " is longer than " << MAP_ENTITY_TYPE_LENGTH << " characters\n";
+			return false;
+		}
+	}
+
+	string tempPath = filePath + ".tmp";
+	ofstream outfile(tempPath, ios::binary);
+	if (!outfile) { return false; }
+
+	MapFileHeader header;
+	header.magic = MAP_FILE_MAGIC;
+	header.version = MAP_FILE_VERSION;
+	header.width = (uint32_t)map.width;
+	header.height = (uint32_t)map.height;
+	header.layerCount = MAP_FILE_LAYERS;
+	header.entityCount = (uint32_t)map.entities.size();
+	outfile.write((const char*)&header, sizeof(header));
+
+	const TileLayer *layers[MAP_FILE_LAYERS] = { &map.levelData, &map.overlayData, &map.temporaryData };
+	vector<uint16_t> tiles(((map.width * map.height + 1) / 2) * 2, 0);
+	for (int layer = 0; layer < MAP_FILE_LAYERS; layer++) {
+		for (int i = 0; i < map.width * map.height; i++) {
+			tiles[i] = (uint16_t)layers[layer]->tiles[i];
+		}
+		outfile.write((const char*)tiles.data(), tiles.size() * sizeof(uint16_t));
+	}
+
+	for (int i = 0; i < (int)map.entities.size(); i++) {
+		MapFileEntity entity;
+		memset(&entity, 0, sizeof(entity));
+		//the type is only null terminated when it is shorter than the field
+		const string &type = map.entities[i].type;
+		memcpy(entity.type, type.data(), min(type.size(), (size_t)MAP_ENTITY_TYPE_LENGTH));
+		entity.x = map.entities[i].x;
+		entity.y = map.entities[i].y;
+		outfile.write((const char*)&entity, sizeof(entity));
+	}
+	outfile.close();
+	if (!outfile.good() || !replaceFile(tempPath, filePath)) {
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+//loads the precompiled version of a map when it is up to date, otherwise parses the text and rebuilds it
+bool loadMap(const string &textPath, LevelMap &map) {
+	string binaryPath = binaryMapPath(textPath);
+	if (isFileNewer(binaryPath, textPath) && loadBinaryMap(binaryPath, map)) {
+		return true;
+	}
+	map.Free();
+	if (!loadTextMap(textPath, map)) { return false; }
+	writeBinaryMap(binaryPath, map);
+	return true;
+}
+
+//--convert-maps: precompile each given text map
+void ConvertMaps(int count, char *files[]) {
+	for (int i = 0; i < count; i++) {
+		LevelMap map;
+		string textPath = files[i];
+		if (!loadTextMap(textPath, map)) {
+			cout << "Unable to read map " << textPath << "\n";
+			continue;
+		}
+		string binaryPath = binaryMapPath(textPath);
+		cout << textPath << " -> " << binaryPath << (writeBinaryMap(binaryPath, map) ? "\n" : " FAILED\n");
+	}
+}
+
+//--bench-maps: time text parsing against precompiled loading for each given text map
+void BenchmarkMapLoading(int count, char *files[]) {
+	const int iterations = 200;
+	for (int i = 0; i < count; i++) {
+		string textPath = files[i];
+		string binaryPath = binaryMapPath(textPath);
+		LevelMap map;
+		if (!loadTextMap(textPath, map) || !writeBinaryMap(binaryPath, map)) {
+			cout << "Unable to prepare map " << textPath << "\n";
+			continue;
+		}
+		map.Free();
+
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		for (int j = 0; j < iterations; j++) {
+			loadTextMap(textPath, map);
+			map.Free();
+		}
+		double textTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() / iterations;
+
+		start = chrono::high_resolution_clock::now();
+		for (int j = 0; j < iterations; j++) {
+			loadBinaryMap(binaryPath, map);
+			map.Free();
+		}
+		double binaryTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() / iterations;
+
+		cout << textPath << ": text " << textTime << " ms, binary " << binaryTime << " ms ("
+			<< (binaryTime > 0.0 ? textTime / binaryTime : 0.0) << "x)\n";
+	}
+}
+
+void populateLevelVector(vector<float> &levelVertexVector, vector<float> &levelTexCoordVector, const TileLayer &layer,
+	int startX, int startY, int endX, int endY) {
+	for (int y = startY; y < endY; y++) {
+		for (int x = startX; x < endX; x++) {
+			int tile = (int)layer.GetUnchecked(x, y);
+			if (tile != 0) {
+				float u = tilesRegion.MapU((float)(tile % SPRITE_COUNT_X) / (float)SPRITE_COUNT_X);
+				float v = tilesRegion.MapV((float)(tile / SPRITE_COUNT_X) / (float)SPRITE_COUNT_Y);
+
+				//manually putting these in b/c of annoying padding in the spritesheet
+				float spriteWidth = 0.069444444f * tilesRegion.width;
+				float spriteHeight = 0.069444444f * tilesRegion.height;
+
+				levelVertexVector.insert(levelVertexVector.end(), {
+					TILE_SIZE * x, -TILE_SIZE * y,
+					TILE_SIZE * x, (-TILE_SIZE * y) - TILE_SIZE,
+					(TILE_SIZE * x) + TILE_SIZE, (-TILE_SIZE * y) - TILE_SIZE,
+					TILE_SIZE * x, -TILE_SIZE * y,
+					(TILE_SIZE * x) + TILE_SIZE, (-TILE_SIZE * y) - TILE_SIZE,
+					(TILE_SIZE * x) + TILE_SIZE, -TILE_SIZE * y
+					});
+				levelTexCoordVector.insert(levelTexCoordVector.end(), {
+					u, v,
+					u, v + (spriteHeight),
+					u + spriteWidth, v + (spriteHeight),
+					u, v,
+					u + spriteWidth, v + (spriteHeight),
+					u + spriteWidth, v
+					});
+			}
+		}
+	}
+}
+
+TileLayerGeometry::TileLayerGeometry() {
+	chunksWide = 0;
+	chunksHigh = 0;
+}
+
+void TileLayerGeometry::Build(const TileLayer &layer) {
+	chunksWide = (layer.width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunksHigh = (layer.height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkVertexData.assign(chunksWide * chunksHigh, vector<float>());
+	chunkTexCoordData.assign(chunksWide * chunksHigh, vector<float>());
+
+	for (int row = 0; row < chunksHigh; row++) {
+		for (int col = 0; col < chunksWide; col++) {
+			int startX = col * CHUNK_SIZE;
+			int startY = row * CHUNK_SIZE;
+			int endX = (startX + CHUNK_SIZE > layer.width ? layer.width : startX + CHUNK_SIZE);
+			int endY = (startY + CHUNK_SIZE > layer.height ? layer.height : startY + CHUNK_SIZE);
+			populateLevelVector(chunkVertexData[row * chunksWide + col], chunkTexCoordData[row * chunksWide + col],
+				layer, startX, startY, endX, endY);
+		}
+	}
+}
+
+void TileLayerGeometry::Clear() {
+	chunkVertexData.clear();
+	chunkTexCoordData.clear();
+}
+
+void LevelMap::BuildGeometry() {
+	levelGeometry.Build(levelData);
+	overlayGeometry.Build(overlayData);
+	temporaryGeometry.Build(temporaryData);
+}
+
+//only the base layer blocks movement
+void LevelMap::BuildCollision(const TilesetProperties &tileset) {
+	collision.Build(levelData, tileset);
+}
+
+LevelLoader::LevelLoader() {
+	result = NULL;
+}
+
+LevelLoader::~LevelLoader() {
+	Cancel();
+}
+
+//begins loading a level in the background; does nothing if that level is already loading or loaded
+void LevelLoader::Start(const char *filename_in) {
+	if (filename_in == filename && (worker.joinable() || result != NULL)) { return; }
+	Cancel();
+	filename = filename_in;
+	worker = thread([this]() {
+		LevelMap *map = new LevelMap();
+		if (loadMap(RESOURCE_FOLDER + filename, *map)) {
+			map->BuildGeometry();
+			map->BuildCollision(tileProperties);
+			result = map;
+		}
+		else {
+			delete map;
+		}
+	});
+}
+
+//hands over the loaded level, waiting for the worker if it hasn't finished or loading in place if it was never started
+LevelMap *LevelLoader::Take(const string &filename_in) {
+	if (filename_in != filename) {
+		Cancel();
+	}
+	if (worker.joinable()) {
+		worker.join();
+	}
+	LevelMap *map = result;
+	result = NULL;
+	filename = "";
+	if (map == NULL) {
+		map = new LevelMap();
+		if (!loadMap(RESOURCE_FOLDER + filename_in, *map)) {
+			delete map;
+			return NULL;
+		}
+		map->BuildGeometry();
+		map->BuildCollision(tileProperties);
+	}
+	return map;
+}
+
+void LevelLoader::Cancel() {
+	if (worker.joinable()) {
+		worker.join();
+	}
+	delete result;
+	result = NULL;
+	filename = "";
+}
+
+//the camera stops a tile short of the map's edges
+void SetCameraBounds() {
 	minCameraX = 1.777f + TILE_SIZE;
 	minCameraY = 1.0f + TILE_SIZE;
-	maxCameraX = (mapWidth * TILE_SIZE) - 1.777f - TILE_SIZE;
-	maxCameraY = (mapHeight * TILE_SIZE) - 1.0f - TILE_SIZE;
+	maxCameraX = (currentMap->width * TILE_SIZE) - 1.777f - TILE_SIZE;
+	maxCameraY = (currentMap->height * TILE_SIZE) - 1.0f - TILE_SIZE;
+}
+
+//the static layers SetupLevel built, waiting for the renderer to upload them; the only level data both threads touch
+class PendingLevel {
+public:
+	PendingLevel();
+
+	mutex lock;
+	int generation;
+	TileLayerGeometry layers[MAP_FILE_LAYERS];
+};
+
+PendingLevel::PendingLevel() {
+	generation = 0;
+}
+
+PendingLevel pendingLevel;
+int uploadedLevelGeneration = 0;
+
+void SetupLevel(string filename, Mix_Music* &music) {
+	//Setup the Level/Objects
+	currentMap = levelLoader.Take(filename);
+	currentMapFile = filename;
+	if (currentMap == NULL) {
+		cout << "Unable to load map " << filename << "\n";
+		assert(false);
+	}
+	world.Clear();
+	playerEntity = NO_ENTITY;
+	for (int i = 0; i < (int)currentMap->entities.size(); i++) {
+		MapEntity &entity = currentMap->entities[i];
+		placeEntity(entity.type, entity.x * TILE_SIZE, entity.y * -TILE_SIZE);
+	}
+	if (playerEntity == NO_ENTITY) {
+		cout << "Map " << filename << " has no player\n";
+		assert(false);
+	}
+
+	//hand the static layers, already built by the loader, to the renderer to upload once
+	levelGeneration++;
+	{
+		lock_guard<mutex> guard(pendingLevel.lock);
+		pendingLevel.generation = levelGeneration;
+		swap(pendingLevel.layers[0], currentMap->levelGeometry);
+		swap(pendingLevel.layers[1], currentMap->overlayGeometry);
+		swap(pendingLevel.layers[2], currentMap->temporaryGeometry);
+	}
+	currentMap->levelGeometry.Clear();
+	currentMap->overlayGeometry.Clear();
+	currentMap->temporaryGeometry.Clear();
+
+	//determine Camera Extremes
+	SetCameraBounds();
 
 	//start the music
 	Mix_PlayMusic(music, -1);
@@ -648,189 +2884,907 @@ void SetupLevel(string filename, Mix_Music* &music) {
 	showTemporary = true;
 }
 
-void DrawText(ShaderProgram &program, GLuint fontTexture, string text, float size, float spacing) {
-	float character_size = 1.0 / 16.0f;
-	vector<float> vertexData;
-	vector<float> texCoordData;
-	for (int i = 0; i < (int)text.size(); i++) {
-		int spriteIndex = (int)text[i];
-		float texture_x = (float)(spriteIndex % 16) / 16.0f;
-		float texture_y = (float)(spriteIndex / 16) / 16.0f;
-		vertexData.insert(vertexData.end(), {
-		((size + spacing) * i) + (-0.5f * size), 0.5f * size,
-		((size + spacing) * i) + (-0.5f * size), -0.5f * size,
-		((size + spacing) * i) + (0.5f * size), 0.5f * size,
-		((size + spacing) * i) + (0.5f * size), -0.5f * size,
-		((size + spacing) * i) + (0.5f * size), 0.5f * size,
-		((size + spacing) * i) + (-0.5f * size), -0.5f * size,
-			});
-		texCoordData.insert(texCoordData.end(), {
-		texture_x, texture_y,
-		texture_x, texture_y + character_size,
-		texture_x + character_size, texture_y,
-		texture_x + character_size, texture_y + character_size,
-		texture_x + character_size, texture_y,
-		texture_x, texture_y + character_size,
-			});
+//frames a cached layout can go unused before it is dropped
+#define TEXT_CACHE_FRAMES 120
+
+//allocations made through CountingAllocator so far, for --bench-text
+size_t countedAllocations = 0;
+
+//std::allocator that counts every allocation, so --bench-text can check a container-heavy class allocates nothing
+//once it is warmed up, without replacing operator new for the whole program. not thread-safe; TextRenderer only
+//runs on the render thread
+template <typename T>
+class CountingAllocator {
+public:
+	typedef T value_type;
+
+	CountingAllocator() {}
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U> &) {}
+
+	T *allocate(size_t count) {
+		countedAllocations++;
+		return allocator<T>().allocate(count);
+	}
+	void deallocate(T *memory, size_t count) {
+		allocator<T>().deallocate(memory, count);
 	}
-	glBindTexture(GL_TEXTURE_2D, fontTexture);
-	float *vertices = vertexData.data();
-	float *texCoords = texCoordData.data();
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &) { return false; }
+
+//lays out each (string, size, spacing) from the font sheet once and keeps it while it is in use.
+//everything queued in a frame is drawn with one draw call, and the vertex buffer is only rewritten
+//when the frame's text or its placement changes
+class TextRenderer {
+	public:
+		TextRenderer();
+
+		void SetFont(const AtlasRegion &font_in);
+		void Add(const string &text, float size, float spacing, const glm::mat4 &matrix);
+		//for text that changes from frame to frame: laid out straight into this frame's vertices, skipping the cache
+		void AddGlyphs(const char *text, float size, float spacing, const glm::mat4 &matrix);
+		void Flush(ShaderProgram &program);
+		void Cleanup();
+
+		typedef vector<float, CountingAllocator<float> > VertexVector;
+
+		//x, y, u, v per vertex, with the first character centered on the origin
+		class Layout {
+		public:
+			VertexVector vertices;
+			int lastUsedFrame;
+			//never reused, unlike the layout's address once Purge frees it
+			unsigned int id;
+		};
+
+		typedef unordered_map<string, Layout, hash<string>, equal_to<string>, CountingAllocator<pair<const string, Layout> > > LayoutMap;
+
+		class Style {
+		public:
+			float size;
+			float spacing;
+			LayoutMap layouts;
+		};
+
+		class QueuedText {
+		public:
+			const Layout *layout;
+			unsigned int layoutID;
+			glm::mat4 matrix;
+		};
+
+		Layout &GetLayout(const string &text, float size, float spacing);
+		void LayOut(const char *text, int length, float size, float spacing, VertexVector &vertices) const;
+		void Purge();
+
+		typedef list<Style, CountingAllocator<Style> > StyleList;
+		typedef vector<QueuedText, CountingAllocator<QueuedText> > QueuedTextVector;
+
+		AtlasRegion font;
+		StyleList styles;
+		QueuedTextVector queued;
+		//only the ids of these are compared; their layouts may have been purged since
+		QueuedTextVector uploaded;
+		VertexVector glyphs;
+		VertexVector uploadedGlyphs;
+		VertexVector glyphScratch;
+		VertexVector staging;
+		unsigned int nextLayoutID;
+
+		GLuint bufferID;
+		size_t bufferCapacity;
+		int uploadedVertices;
+		int frame;
+
+		int drawCalls;
+		int uploads;
+		int layoutsBuilt;
+};
+
+TextRenderer::TextRenderer() {
+	bufferID = 0;
+	bufferCapacity = 0;
+	uploadedVertices = 0;
+	nextLayoutID = 0;
+	frame = 0;
+	drawCalls = 0;
+	uploads = 0;
+	layoutsBuilt = 0;
+}
 
-	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 0, vertices);
+//layouts hold texture coordinates, so they are thrown away when the font moves
+void TextRenderer::SetFont(const AtlasRegion &font_in) {
+	font = font_in;
+	styles.clear();
+	uploaded.clear();
+	uploadedGlyphs.clear();
+}
+
+TextRenderer::Layout &TextRenderer::GetLayout(const string &text, float size, float spacing) {
+	Style *style = NULL;
+	for (StyleList::iterator it = styles.begin(); it != styles.end(); it++) {
+		if (it->size == size && it->spacing == spacing) {
+			style = &(*it);
+			break;
+		}
+	}
+	if (style == NULL) {
+		styles.push_back(Style());
+		style = &styles.back();
+		style->size = size;
+		style->spacing = spacing;
+	}
+
+	LayoutMap::iterator found = style->layouts.find(text);
+	if (found != style->layouts.end()) { return found->second; }
+
+	Layout &layout = style->layouts[text];
+	layout.id = nextLayoutID++;
+	layoutsBuilt++;
+	LayOut(text.data(), (int)text.size(), size, spacing, layout.vertices);
+	return layout;
+}
+
+void TextRenderer::LayOut(const char *text, int length, float size, float spacing, VertexVector &vertices) const {
+	float character_width = font.width / 16.0f;
+	float character_height = font.height / 16.0f;
+	vertices.reserve(vertices.size() + length * 24);
+	for (int i = 0; i < length; i++) {
+		int spriteIndex = (int)(unsigned char)text[i];
+		float texture_x = font.MapU((float)(spriteIndex % 16) / 16.0f);
+		float texture_y = font.MapV((float)(spriteIndex / 16) / 16.0f);
+		float left = ((size + spacing) * i) + (-0.5f * size);
+		float right = ((size + spacing) * i) + (0.5f * size);
+		float top = 0.5f * size;
+		float bottom = -0.5f * size;
+		vertices.insert(vertices.end(), {
+			left, top, texture_x, texture_y,
+			left, bottom, texture_x, texture_y + character_height,
+			right, top, texture_x + character_width, texture_y,
+			right, bottom, texture_x + character_width, texture_y + character_height,
+			right, top, texture_x + character_width, texture_y,
+			left, bottom, texture_x, texture_y + character_height,
+		});
+	}
+}
+
+void TextRenderer::Add(const string &text, float size, float spacing, const glm::mat4 &matrix) {
+	ProfileScope scope(PROFILE_TEXT);
+	if (text.empty()) { return; }
+	Layout &layout = GetLayout(text, size, spacing);
+	layout.lastUsedFrame = frame;
+	QueuedText entry;
+	entry.layout = &layout;
+	entry.layoutID = layout.id;
+	entry.matrix = matrix;
+	queued.push_back(entry);
+}
+
+void TextRenderer::AddGlyphs(const char *text, float size, float spacing, const glm::mat4 &matrix) {
+	ProfileScope scope(PROFILE_TEXT);
+	glyphScratch.clear();
+	LayOut(text, (int)strlen(text), size, spacing, glyphScratch);
+	for (int v = 0; v < (int)glyphScratch.size(); v += 4) {
+		glm::vec4 position = matrix * glm::vec4(glyphScratch[v], glyphScratch[v + 1], 0.0f, 1.0f);
+		glyphs.push_back(position[0]);
+		glyphs.push_back(position[1]);
+		glyphs.push_back(glyphScratch[v + 2]);
+		glyphs.push_back(glyphScratch[v + 3]);
+	}
+}
+
+void TextRenderer::Purge() {
+	for (StyleList::iterator style = styles.begin(); style != styles.end(); style++) {
+		for (LayoutMap::iterator it = style->layouts.begin(); it != style->layouts.end();) {
+			if (frame - it->second.lastUsedFrame > TEXT_CACHE_FRAMES) { it = style->layouts.erase(it); }
+			else { it++; }
+		}
+	}
+}
+
+//draws everything queued since the last Flush. matrices are applied on the CPU, so the caller's view should be identity
+void TextRenderer::Flush(ShaderProgram &program) {
+	ProfileScope scope(PROFILE_TEXT);
+	frame++;
+	if (frame % TEXT_CACHE_FRAMES == 0) { Purge(); }
+	if (queued.empty() && glyphs.empty()) { return; }
+
+	bool changed = (queued.size() != uploaded.size() || glyphs != uploadedGlyphs);
+	for (int i = 0; i < (int)queued.size() && !changed; i++) {
+		changed = (queued[i].layoutID != uploaded[i].layoutID || queued[i].matrix != uploaded[i].matrix);
+	}
+
+	if (bufferID == 0) { glGenBuffers(1, &bufferID); }
+	glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+	if (changed) {
+		staging.clear();
+		for (int i = 0; i < (int)queued.size(); i++) {
+			const VertexVector &vertices = queued[i].layout->vertices;
+			const glm::mat4 &matrix = queued[i].matrix;
+			for (int v = 0; v < (int)vertices.size(); v += 4) {
+				glm::vec4 position = matrix * glm::vec4(vertices[v], vertices[v + 1], 0.0f, 1.0f);
+				staging.push_back(position[0]);
+				staging.push_back(position[1]);
+				staging.push_back(vertices[v + 2]);
+				staging.push_back(vertices[v + 3]);
+			}
+		}
+		staging.insert(staging.end(), glyphs.begin(), glyphs.end());
+		if (staging.size() > bufferCapacity) {
+			glBufferData(GL_ARRAY_BUFFER, staging.size() * sizeof(float), staging.data(), GL_DYNAMIC_DRAW);
+			bufferCapacity = staging.size();
+		}
+		else {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, staging.size() * sizeof(float), staging.data());
+		}
+		uploaded = queued;
+		uploadedGlyphs = glyphs;
+		uploadedVertices = (int)staging.size() / 4;
+		uploads++;
+	}
+
+	program.SetModelMatrix(glm::mat4(1.0f));
+	glBindTexture(GL_TEXTURE_2D, font.textureID);
+	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(program.positionAttribute);
-	
-	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 0, texCoords);
+	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 	glEnableVertexAttribArray(program.texCoordAttribute);
 
-	glDrawArrays(GL_TRIANGLES, 0, text.size() * 6);
+	glDrawArrays(GL_TRIANGLES, 0, uploadedVertices);
+	drawCalls++;
+
 	glDisableVertexAttribArray(program.positionAttribute);
 	glDisableVertexAttribArray(program.texCoordAttribute);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	queued.clear();
+	glyphs.clear();
+}
 
+void TextRenderer::Cleanup() {
+	if (bufferID != 0) {
+		glDeleteBuffers(1, &bufferID);
+		bufferID = 0;
+	}
+	bufferCapacity = 0;
+	styles.clear();
+	uploaded.clear();
+	glyphs.clear();
+	uploadedGlyphs.clear();
 }
 
+TextRenderer textRenderer;
+
 void worldToTileCoordinates(float worldX, float worldY, int *gridX, int *gridY) {
 	*gridX = (int)(worldX / TILE_SIZE);
 	*gridY = (int)(worldY / -TILE_SIZE);
 }
 
-void HandleTilemapCollisionY(Entity &entity) {
-	float worldX, worldY;
-	int gridX, gridY;
-	unsigned int tileIndex;
+//gap left between an entity and a tile it was stopped against, in tiles
+#define COLLISION_SKIN 0.005f
+
+//moves the entity's box along one axis (0 = x, 1 = y) by delta, walking the grid one tile row/column at a time
+//across the box's whole width, and stops it at the first solid tile it would enter.
+//this is a per-axis sweep, not a time of impact along the velocity: MovementSystem sweeps y and then x, so the box
+//never ends up inside a tile, but it follows an L-shaped path and can slip past a corner the diagonal would clip
+void SweepTilemapAxis(EntityID entity, int axis, float delta) {
+	glm::vec3 &position = world.position[entity];
+	const glm::vec3 &size = world.size[entity];
+
+	//work in grid units with y flipped, so rows and columns both grow with the coordinate
+	float flip = (axis == 0 ? 1.0f : -1.0f);
+	float center = position[axis] * flip / TILE_SIZE;
+	float half = 0.5f * size[axis] / TILE_SIZE;
+	float move = delta * flip / TILE_SIZE;
+
+	int other = 1 - axis;
+	float otherFlip = (other == 0 ? 1.0f : -1.0f);
+	float otherCenter = position[other] * otherFlip / TILE_SIZE;
+	float otherHalf = 0.5f * size[other] / TILE_SIZE;
+	int firstCell = (int)floor(otherCenter - otherHalf + COLLISION_SKIN);
+	int lastCell = (int)floor(otherCenter + otherHalf - COLLISION_SKIN);
+
+	float lead = center + (move >= 0.0f ? half : -half);
+	int startLine, endLine, step;
+	if (move >= 0.0f) {
+		startLine = (int)floor(lead);
+		endLine = (int)floor(lead + move);
+		step = 1;
+	}
+	else {
+		startLine = (int)ceil(lead) - 1;
+		endLine = (int)ceil(lead + move) - 1;
+		step = -1;
+	}
 
-	entity.collidedTop = false;
-	entity.collidedBottom = false;
+	float moved = move;
+	bool hit = false;
+	for (int line = startLine; line != endLine + step && !hit; line += step) {
+		for (int cell = firstCell; cell <= lastCell; cell++) {
+			bool solid = (axis == 0 ? currentMap->collision.IsSolid(line, cell) : currentMap->collision.IsSolid(cell, line));
+			if (solid) {
+				moved = (move >= 0.0f ? (line - COLLISION_SKIN) - lead : (line + 1 + COLLISION_SKIN) - lead);
+				hit = true;
+				break;
+			}
+		}
+	}
 
-	//check top
-	worldX = entity.position[0];
-	worldY = entity.position[1] + 0.5f * entity.size[1];
-	worldToTileCoordinates(worldX, worldY, &gridX, &gridY);
-	tileIndex = levelData[gridY][gridX] + 1;
-	for (int i = 0; i < NUM_SOLIDS; i++) {
-		//check if tile at top is solid
-		if (tileIndex == solid_indices[i]) {
-			//stop moving vertically
-			entity.velocity[1] = 0.0f;
+	position[axis] += moved * TILE_SIZE * flip;
+	if (!hit) { return; }
 
-			//set collision flag
-			entity.collidedTop = true;
+	world.velocity[entity][axis] = 0.0f;
+	if (axis == 0) {
+		world.collided[entity] |= (move >= 0.0f ? COLLIDED_RIGHT : COLLIDED_LEFT);
+	}
+	else {
+		world.collided[entity] |= (move >= 0.0f ? COLLIDED_BOTTOM : COLLIDED_TOP);
+	}
+}
 
-			//push out of tile
-			entity.position[1] -= (worldY - ((-TILE_SIZE * gridY) - TILE_SIZE)) + 0.001f;
-			break;
+void HandleTilemapCollisionY(EntityID entity, float elapsed) {
+	world.collided[entity] &= ~(COLLIDED_TOP | COLLIDED_BOTTOM);
+	SweepTilemapAxis(entity, 1, world.velocity[entity][1] * elapsed);
+}
+
+void HandleTilemapCollisionX(EntityID entity, float elapsed) {
+	world.collided[entity] &= ~(COLLIDED_LEFT | COLLIDED_RIGHT);
+	SweepTilemapAxis(entity, 0, world.velocity[entity][0] * elapsed);
+}
+
+//--bench-collision: time the solid-tile test for many entities probing a map, linear solid list vs bitmap
+void BenchmarkTileCollision(const char *mapFile, int entityCount) {
+	LevelMap map;
+	if (!loadMap(mapFile, map)) {
+		cout << "Unable to load map " << mapFile << "\n";
+		return;
+	}
+	map.BuildCollision(tileProperties);
+
+	//the old path: tile index compared against every entry of a list of solid tiles
+	vector<unsigned int> solidList;
+	for (int i = 0; i < (int)tileProperties.solid.size(); i++) {
+		if (tileProperties.solid[i]) { solidList.push_back(i + 1); }
+	}
+
+	vector<glm::vec3> positions(entityCount);
+	for (int i = 0; i < entityCount; i++) {
+		positions[i] = glm::vec3((rand() % (map.width * 100)) / 100.0f * TILE_SIZE, -(rand() % (map.height * 100)) / 100.0f * TILE_SIZE, 0.0f);
+	}
+	const int steps = 60;
+	const float halfSize = 0.08f;
+	float offsets[4][2] = { { 0.0f, halfSize }, { 0.0f, -halfSize }, { -halfSize, 0.0f }, { halfSize, 0.0f } };
+
+	int linearHits = 0;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int step = 0; step < steps; step++) {
+		for (int i = 0; i < entityCount; i++) {
+			for (int probe = 0; probe < 4; probe++) {
+				int gridX, gridY;
+				worldToTileCoordinates(positions[i][0] + offsets[probe][0], positions[i][1] + offsets[probe][1], &gridX, &gridY);
+				unsigned int tileIndex = map.levelData.Get(gridX, gridY) + 1;
+				for (int j = 0; j < (int)solidList.size(); j++) {
+					if (tileIndex == solidList[j]) { linearHits++; break; }
+				}
+			}
+		}
+	}
+	double linearTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	int bitmapHits = 0;
+	start = chrono::high_resolution_clock::now();
+	for (int step = 0; step < steps; step++) {
+		for (int i = 0; i < entityCount; i++) {
+			for (int probe = 0; probe < 4; probe++) {
+				int gridX, gridY;
+				worldToTileCoordinates(positions[i][0] + offsets[probe][0], positions[i][1] + offsets[probe][1], &gridX, &gridY);
+				if (map.collision.IsSolid(gridX, gridY)) { bitmapHits++; }
+			}
 		}
 	}
+	double bitmapTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
 
-	//check bottom
-	worldX = entity.position[0];
-	worldY = entity.position[1] - 0.5f * entity.size[1];
-	worldToTileCoordinates(worldX, worldY, &gridX, &gridY);
-	tileIndex = levelData[gridY][gridX] + 1;
-	for (int i = 0; i < NUM_SOLIDS; i++) {
-		//check if tile at bottom is solid
-		if (tileIndex == solid_indices[i]) {
-			//stop moving vertically
-			entity.velocity[1] = 0.0f;
+	cout << entityCount << " entities x " << steps << " steps, " << solidList.size() << " solid tiles\n";
+	cout << "linear: " << linearTime / steps << " ms/step (" << linearHits << " hits)\n";
+	cout << "bitmap: " << bitmapTime / steps << " ms/step (" << bitmapHits << " hits)\n";
+}
 
-			//set collision flag
-			entity.collidedBottom = true;
+//a sprite as the renderer sees it, where it started and ended the last step
+struct SpriteSnapshot {
+	SheetSprite sprite;
+	glm::vec3 previousPosition;
+	glm::vec3 position;
+	//size, flipped for facing and squished
+	glm::vec3 scale;
+};
 
-			//push out of tile
-			entity.position[1] += ((-TILE_SIZE * gridY) - worldY) + 0.001f;
-			break;
+//everything Render reads from the simulation, copied out after a step. Render never looks at the World or
+//the game globals directly, so with --sim-thread the simulation can keep stepping while a snapshot is drawn
+class RenderSnapshot {
+public:
+	RenderSnapshot();
+
+	void Capture();
+
+	//profiler time it was captured at, in microseconds
+	double time;
+	gameMode mode;
+	int levelGeneration;
+	glm::vec3 clearColor;
+	float minCameraX, minCameraY, maxCameraX, maxCameraY;
+	glm::vec3 previousCameraTarget;
+	glm::vec3 cameraTarget;
+	vector<SpriteSnapshot> sprites;
+	bool showOverlay;
+	bool showTemporary;
+	bool showFlavorText;
+	bool showPyrotechnics;
+	string flavorText;
+	vector<QuadInstance> particles;
+};
+
+RenderSnapshot::RenderSnapshot() {
+	time = 0.0;
+	mode = MODE_START;
+	levelGeneration = 0;
+	clearColor = glm::vec3(0.0f, 0.0f, 0.0f);
+	minCameraX = minCameraY = maxCameraX = maxCameraY = 0.0f;
+	previousCameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
+	cameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
+	showOverlay = false;
+	showTemporary = false;
+	showFlavorText = false;
+	showPyrotechnics = false;
+}
+
+//reuses the vectors' and string's storage, so capturing every step doesn't allocate
+void RenderSnapshot::Capture() {
+	time = profiler.Now();
+	mode = ::mode;
+	levelGeneration = ::levelGeneration;
+	clearColor = ::clearColor;
+	minCameraX = ::minCameraX;
+	minCameraY = ::minCameraY;
+	maxCameraX = ::maxCameraX;
+	maxCameraY = ::maxCameraY;
+	if (playerEntity != NO_ENTITY) {
+		previousCameraTarget = world.previousPosition[playerEntity];
+		cameraTarget = world.position[playerEntity];
+	}
+
+	sprites.clear();
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (!world.Has(entity, COMPONENT_SPRITE)) { continue; }
+		SpriteSnapshot snapshot;
+		snapshot.sprite = world.sprite[entity];
+		snapshot.previousPosition = world.previousPosition[entity];
+		snapshot.position = world.position[entity];
+		const glm::vec3 &size = world.size[entity];
+		snapshot.scale = glm::vec3((world.facingRight[entity] ? size[0] : -size[0]), size[1], size[2]);
+		if (world.Has(entity, COMPONENT_PLAYER)) { snapshot.scale *= world.squish[entity]; }
+		sprites.push_back(snapshot);
+	}
+
+	showOverlay = ::showOverlay;
+	showTemporary = ::showTemporary;
+	showFlavorText = ::showFlavorText;
+	showPyrotechnics = ::showPyrotechnics;
+	flavorText = ::flavorText;
+
+	particles.clear();
+	if (showPyrotechnics) {
+		for (int i = 0; i < ParticleEmitters.Count(); i++) {
+			ParticleEmitters.Live(i).AppendInstances(particles);
+		}
+	}
+}
+
+//the snapshot drawn by the single-threaded loop and --headless, captured right before each frame
+RenderSnapshot frameSnapshot;
+
+//hands the newest snapshot from the simulation thread to the render thread without either one waiting.
+//of the three slots one is being written, one is being drawn, and the middle one holds the newest finished
+//snapshot; each side swaps its slot with the middle through one atomic exchange
+class SnapshotBuffer {
+public:
+	SnapshotBuffer();
+
+	RenderSnapshot &WriteSlot();
+	void Publish();
+	//switches to the newest published snapshot; false if nothing was published since the last call
+	bool Acquire();
+	const RenderSnapshot &ReadSlot() const;
+
+private:
+	RenderSnapshot slots[3];
+	//index of the middle slot, plus SNAPSHOT_FRESH once the writer has published into it
+	atomic<int> middle;
+	int writeIndex;
+	int readIndex;
+};
+
+#define SNAPSHOT_FRESH 4
+#define SNAPSHOT_INDEX 3
+
+SnapshotBuffer::SnapshotBuffer() {
+	writeIndex = 0;
+	middle = 1;
+	readIndex = 2;
+}
+
+RenderSnapshot &SnapshotBuffer::WriteSlot() {
+	return slots[writeIndex];
+}
+
+void SnapshotBuffer::Publish() {
+	writeIndex = middle.exchange(writeIndex | SNAPSHOT_FRESH) & SNAPSHOT_INDEX;
+}
+
+bool SnapshotBuffer::Acquire() {
+	if (!(middle.load() & SNAPSHOT_FRESH)) { return false; }
+	readIndex = middle.exchange(readIndex) & SNAPSHOT_INDEX;
+	return true;
+}
+
+const RenderSnapshot &SnapshotBuffer::ReadSlot() const {
+	return slots[readIndex];
+}
+
+//blends the start and end of a step; alpha 1 gives exactly the end
+glm::vec3 interpolate(const glm::vec3 &previous, const glm::vec3 &current, float alpha) {
+	return current * alpha + previous * (1.0f - alpha);
+}
+
+glm::vec3 getCameraPos(const RenderSnapshot &snapshot, float alpha) {
+	glm::vec3 currentPos = interpolate(snapshot.previousCameraTarget, snapshot.cameraTarget, alpha);
+
+	currentPos[0] = (currentPos[0] < snapshot.minCameraX ? -snapshot.minCameraX : (currentPos[0] > snapshot.maxCameraX ? -snapshot.maxCameraX : -currentPos[0]));
+
+	currentPos[1] = (currentPos[1] < -snapshot.maxCameraY ? snapshot.maxCameraY : (currentPos[1] > -snapshot.minCameraY ? snapshot.minCameraY : -currentPos[1]));
+
+	return currentPos;
+}
+
+//world-space rect currently covered by the camera
+void getViewBounds(const RenderSnapshot &snapshot, float alpha, float *left, float *right, float *bottom, float *top) {
+	glm::vec3 cameraPos = getCameraPos(snapshot, alpha);
+	*left = -cameraPos[0] - VIEW_HALF_WIDTH;
+	*right = -cameraPos[0] + VIEW_HALF_WIDTH;
+	*bottom = -cameraPos[1] - VIEW_HALF_HEIGHT;
+	*top = -cameraPos[1] + VIEW_HALF_HEIGHT;
+}
+
+void ExitLevel() {
+	delete currentMap;
+	currentMap = NULL;
+	currentMapFile = "";
+	levelGeneration++;
+
+	ParticleEmitters.Clear();
+
+	Mix_HaltMusic();
+}
+
+//copies the layers of a re-read map that differ from the current level, rebuilding and uploading only those.
+//entities stay where they are so the player keeps their place
+int ApplyMapChanges(LevelMap &changedMap) {
+	bool resized = (changedMap.width != currentMap->width || changedMap.height != currentMap->height);
+	TileLayer *layers[MAP_FILE_LAYERS] = { &currentMap->levelData, &currentMap->overlayData, &currentMap->temporaryData };
+	TileLayer *changedLayers[MAP_FILE_LAYERS] = { &changedMap.levelData, &changedMap.overlayData, &changedMap.temporaryData };
+	TileLayerBuffer *buffers[MAP_FILE_LAYERS] = { &levelBuffer, &overlayBuffer, &temporaryBuffer };
+
+	int rebuilt = 0;
+	for (int layer = 0; layer < MAP_FILE_LAYERS; layer++) {
+		if (!resized && layers[layer]->tiles == changedLayers[layer]->tiles) { continue; }
+		*layers[layer] = *changedLayers[layer];
+		TileLayerGeometry geometry;
+		geometry.Build(*layers[layer]);
+		buffers[layer]->Upload(geometry);
+		rebuilt++;
+	}
+	if (resized || layers[0]->tiles != changedLayers[0]->tiles) {
+		currentMap->BuildCollision(tileProperties);
+	}
+	if (resized) {
+		currentMap->width = changedMap.width;
+		currentMap->height = changedMap.height;
+		SetCameraBounds();
+	}
+	return rebuilt;
+}
+
+//--hot-reload: recompiles shaders and re-reads maps as they are saved. a shader that fails to compile leaves
+//the old program running, and a map that isn't loaded yet just has its precompiled copy refreshed
+void HotReload(FileWatcher &watcher) {
+	vector<string> changed;
+	if (!watcher.Poll(changed)) { return; }
+
+	ShaderProgram *programs[2] = { &program, &quadProgram };
+	for (int i = 0; i < (int)changed.size(); i++) {
+		const string &path = changed[i];
+		bool isShader = false;
+		for (int j = 0; j < 2; j++) {
+			if (path != programs[j]->vertexShaderPath && path != programs[j]->fragmentShaderPath) { continue; }
+			isShader = true;
+			if (programs[j]->Reload()) {
+				cout << "Reloaded " << programs[j]->vertexShaderPath << " + " << programs[j]->fragmentShaderPath << "\n";
+			}
+			else {
+				cout << "Keeping the old program, " << path << " failed to compile or link\n";
+			}
+		}
+		if (isShader) { continue; }
+
+		//the loader may be reading this map's precompiled copy or rewriting it from the saved text, so it has
+		//to finish before the copy is replaced
+		if (RESOURCE_FOLDER + levelLoader.filename == path) {
+			levelLoader.Cancel();
+		}
+		LevelMap changedMap;
+		if (!loadTextMap(path, changedMap)) {
+			cout << "Unable to reload map " << path << "\n";
+			continue;
+		}
+		writeBinaryMap(binaryMapPath(path), changedMap);
+		if (currentMap != NULL && RESOURCE_FOLDER + currentMapFile == path) {
+			int rebuilt = ApplyMapChanges(changedMap);
+			cout << "Reloaded " << path << ", rebuilt " << rebuilt << " of " << MAP_FILE_LAYERS << " layers\n";
 		}
 	}
 }
 
-void HandleTilemapCollisionX(Entity &entity) {
-	float worldX, worldY;
-	int gridX, gridY;
-	unsigned int tileIndex;
+bool DoorsLocked() {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (world.Has(entity, COMPONENT_DOOR) && !world.isLocked[entity]) { return false; }
+	}
+	return true;
+}
 
-	entity.collidedLeft = false;
-	entity.collidedRight = false;
+void UnlockDoors() {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (world.Has(entity, COMPONENT_DOOR)) { world.isLocked[entity] = false; }
+	}
+}
 
-	//check left
-	worldX = entity.position[0] - 0.5f * entity.size[0];
-	worldY = entity.position[1];
-	worldToTileCoordinates(worldX, worldY, &gridX, &gridY);
-	tileIndex = levelData[gridY][gridX] + 1;
-	for (int i = 0; i < NUM_SOLIDS; i++) {
-		//check if tile at left is solid
-		if (tileIndex == solid_indices[i]) {
-			//stop moving horizontally
-			entity.velocity[0] = 0.0f;
+//whether the player overlaps any entity with one of the given components
+bool PlayerTouching(unsigned int components) {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if ((world.mask[entity] & components) != 0 && world.Overlapping(entity, playerEntity)) { return true; }
+	}
+	return false;
+}
 
-			//set collision flag
-			entity.collidedLeft = true;
+//steps animation clips, and squashes the player by their vertical speed
+void AnimationSystem(float elapsed) {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (world.Has(entity, COMPONENT_ANIMATION)) {
+			world.elapsedSinceLastAnim[entity] += elapsed;
+			if (world.elapsedSinceLastAnim[entity] >= 1.0f / world.animFPS[entity]) {
+				const AnimationClip &clip = *world.clip[entity];
+				int frame = world.animFrame[entity];
+				world.sprite[entity].u = clip.frames[frame * 2];
+				world.sprite[entity].v = clip.frames[frame * 2 + 1];
+				world.animFrame[entity] = (frame + 1) % clip.frameCount;
+				world.elapsedSinceLastAnim[entity] = 0.0f;
+			}
+		}
+		if (world.Has(entity, COMPONENT_PLAYER)) {
+			float stretch = abs(world.velocity[entity][1] / 2.0f);
+			world.squish[entity] = glm::vec3(lerp(1.0f, 0.7f, stretch), lerp(1.0f, 1.5f, stretch), 1.0f);
+		}
+	}
+}
+
+//resets every body's acceleration to its gravity, or to nothing while it's standing on something
+void GravitySystem() {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (!world.Has(entity, COMPONENT_BODY)) { continue; }
+		world.acceleration[entity] = glm::vec3(0.0f, 0.0f, 0.0f);
+		if (!(world.collided[entity] & COLLIDED_BOTTOM)) {
+			world.acceleration[entity][1] = world.gravity[entity];
+		}
+	}
+}
+
+void PlayerInputSystem(const Uint8 *keys) {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (!world.Has(entity, COMPONENT_PLAYER | COMPONENT_BODY)) { continue; }
+		unsigned char collided = world.collided[entity];
+
+		//move left and right
+		if (!(collided & COLLIDED_LEFT) && keys[SDL_SCANCODE_LEFT]) {
+			world.acceleration[entity][0] = -1.5f;
+			world.facingRight[entity] = false;
+		}
+		else if (!(collided & COLLIDED_RIGHT) && keys[SDL_SCANCODE_RIGHT]) {
+			world.acceleration[entity][0] = 1.5f;
+			world.facingRight[entity] = true;
+		}
+
+		//jump
+		if ((collided & COLLIDED_BOTTOM) && keys[SDL_SCANCODE_SPACE]) {
+			world.velocity[entity][1] = 2.0f;
+			Mix_PlayChannel(-1, jump, 0);
+		}
+	}
+}
+
+//bodies per ParallelFor batch; a level's handful of bodies stays on the calling thread
+#define MOVEMENT_BATCH 1024
+
+//integrates velocity one axis at a time; HandleTilemapCollisionX/Y then move the body so it can't pass through tiles.
+//a body only reads the static tilemap and writes its own columns, so batches of them can move on different threads
+//and end up exactly where they would have serially
+void MovementSystem(float elapsed) {
+	ProfileScope scope(PROFILE_COLLISION);
+	jobs.ParallelFor(world.Count(), MOVEMENT_BATCH, [elapsed](int begin, int end) {
+		for (EntityID entity = begin; entity < end; entity++) {
+			if (!world.Has(entity, COMPONENT_BODY)) { continue; }
+			glm::vec3 &velocity = world.velocity[entity];
+			const glm::vec3 &acceleration = world.acceleration[entity];
+
+			velocity[1] += acceleration[1] * elapsed;
+			HandleTilemapCollisionY(entity, elapsed);
+
+			velocity[0] += acceleration[0] * elapsed;
+			velocity[0] = lerp(velocity[0], 0.0f, 2.0f * elapsed);
+			HandleTilemapCollisionX(entity, elapsed);
+		}
+	});
+}
+
+void PickupSystem() {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (!world.Has(entity, COMPONENT_PICKUP) || !world.Overlapping(entity, playerEntity)) { continue; }
+		Mix_PlayChannel(-1, pickup, 0);
+		world.Remove(entity);
+		UnlockDoors();
+		showTemporary = false;
+	}
+}
+
+void SignSystem(const Uint8 *keys) {
+	if (!PlayerTouching(COMPONENT_SIGN)) { return; }
+	showFlavorText = true;
+	switch (mode) {
+	case MODE_OUTDOORS:
+		flavorText = "What a terrible sign!";
+		break;
+	case MODE_STORE:
+		flavorText = (showOverlay ? "I can't see a thing! (Press UP to light torch)" : "Woah, it's lit in here!");
+		if (keys[SDL_SCANCODE_UP]) {
+			showOverlay = false;
+			showTemporary = false;
+			showPyrotechnics = true;
+			UnlockDoors();
+		}
+		break;
+	case MODE_EXIT:
+		flavorText = "If I get to close to that bee's turf, he'll come after me.";
+		break;
+	default:
+		break;
+	}
+}
 
-			//push out of tile
-			entity.position[0] += (((TILE_SIZE * gridX) + TILE_SIZE) - worldX) + 0.001f;
+//an unlocked door moves the player on to the next level; the world is rebuilt when it does
+void DoorSystem(const Uint8 *keys) {
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (!world.Has(entity, COMPONENT_DOOR) || !world.Overlapping(entity, playerEntity)) { continue; }
+		bool isLocked = (world.isLocked[entity] != 0);
+		showFlavorText = true;
+		flavorText = (isLocked ? "It's locked." : "Press UP to proceed.");
+		if (isLocked || !keys[SDL_SCANCODE_UP]) { continue; }
+
+		switch (mode) {
+		case MODE_OUTDOORS:
+			ExitLevel();
+			clearColor = glm::vec3(0.6f, 0.41961f, 0.29f);
+			mode = MODE_STORE;
+			/*for (int i = 0; i < 4; i++) {
+				ParticleEmitters.Acquire()->Reset(15, 3.0f, glm::vec3((float)i, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+			} */
+			SetupLevel("FinalMap_Store.txt", bgm_store);
+			break;
+		case MODE_STORE:
+			ExitLevel();
+			clearColor = glm::vec3(0.05f, 0.46f, 0.8f);
+			mode = MODE_EXIT;
+			SetupLevel("FinalMap_Exit.txt", bgm_exit);
+			UnlockDoors();
+			break;
+		case MODE_EXIT:
+			ExitLevel();
+			mode = MODE_VICTORY;
+			break;
+		default:
 			break;
 		}
+		return;
 	}
+}
+
+//chasers get angry while the player is within a unit of their home, and fly back to it otherwise
+void ChaserSystem(float elapsed) {
+	glm::vec3 playerPos = world.position[playerEntity];
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (!world.Has(entity, COMPONENT_CHASER)) { continue; }
+		glm::vec3 &position = world.position[entity];
+		glm::vec3 &velocity = world.velocity[entity];
+		const glm::vec3 &homePos = world.homePos[entity];
+
+		world.isAngry[entity] = (abs(homePos[0] - playerPos[0]) < 1.0f);
+		if (world.isAngry[entity]) {
+			velocity[0] = (position[0] - playerPos[0] < 0.0f ? 0.25f : -0.25f);
+			velocity[1] = (position[1] - playerPos[1] < 0.0f ? 0.25f : -0.25f);
+		}
+		else if (abs(homePos[0] - position[0]) > 0.2f || abs(homePos[1] - position[1]) > 0.2f) {
+			velocity[0] = (position[0] - homePos[0] < 0.0f ? 1.0f : -1.0f);
+			velocity[1] = (position[1] - homePos[1] < 0.0f ? 1.0f : -1.0f);
+		}
+		else {
+			velocity[0] = 0.0f;
+			velocity[1] = 0.0f;
+		}
+		//move
+		position[0] += velocity[0] * elapsed;
+		position[1] += velocity[1] * elapsed;
 
-	//check right
-	worldX = entity.position[0] + 0.5f * entity.size[0];
-	worldY = entity.position[1];
-	worldToTileCoordinates(worldX, worldY, &gridX, &gridY);
-	tileIndex = levelData[gridY][gridX] + 1;
-	for (int i = 0; i < NUM_SOLIDS; i++) {
-		//check if tile at right is solid
-		if (tileIndex == solid_indices[i]) {
-			//stop moving horizontally
-			entity.velocity[0] = 0.0f;
+		//apply random jitters
+		float randPercentX = (float)((rand() % 201) - 100) / 100.0f;
+		float randPercentY = (float)((rand() % 201) - 100) / 100.0f;
+		position[0] += 0.01 * randPercentX;
+		position[1] += 0.01 * randPercentY;
 
-			//set collision flag
-			entity.collidedRight = true;
+		world.facingRight[entity] = velocity[0] >= 0.0f;
 
-			//push out of tile
-			entity.position[0] -= (worldX - (TILE_SIZE * gridX)) + 0.001f;
-			break;
+		if (world.Overlapping(entity, playerEntity)) {
+			ExitLevel();
+			mode = MODE_GAMEOVER;
+			return;
 		}
 	}
 }
 
-glm::vec3 getCameraPos() {
-	glm::vec3 currentPos = Player.position;
-
-	currentPos[0] = (currentPos[0] < minCameraX ? -minCameraX : (currentPos[0] > maxCameraX ? -maxCameraX : -currentPos[0]));
-
-	currentPos[1] = (currentPos[1] < -maxCameraY ? maxCameraY : (currentPos[1] > -minCameraY ? minCameraY : -currentPos[1]));
-
-	return currentPos;
-}
-
-void ExitLevel() {
-	for (int i = 0; i < mapHeight; i++) {
-		delete[] levelData[i];
-		delete[] overlayData[i];
-		delete[] temporaryData[i];
+void DrawSystem(SpriteBatch &batch, const RenderSnapshot &snapshot, float alpha) {
+	for (int i = 0; i < (int)snapshot.sprites.size(); i++) {
+		const SpriteSnapshot &sprite = snapshot.sprites[i];
+		batch.Add(sprite.sprite, interpolate(sprite.previousPosition, sprite.position, alpha), sprite.scale);
 	}
-	delete[] levelData;
-	delete[] overlayData;
-	delete[] temporaryData;
-
-	level_vertexData.clear();
-	level_texCoordData.clear();
-	overlay_vertexData.clear();
-	overlay_texCoordData.clear();
-	temporary_vertexData.clear();
-	temporary_texCoordData.clear();
+}
 
-	if (!ParticleEmitters.empty()) {
-		for (int i = 0; i < ParticleEmitters.size(); i++) {
-			ParticleEmitters[i].particles.clear();
-		}
-		ParticleEmitters.clear();
+//the level reachable from the current mode, so it can be loaded before the player gets there
+const char *nextLevelFile() {
+	switch (mode) {
+	case MODE_START:
+	case MODE_VICTORY:
+		return "FinalMap_Outdoors.txt";
+	case MODE_GAMEOVER:
+		return "FinalMap_Exit.txt";
+	case MODE_OUTDOORS:
+		return (DoorsLocked() ? NULL : "FinalMap_Store.txt");
+	case MODE_STORE:
+		return (DoorsLocked() ? NULL : "FinalMap_Exit.txt");
+	default:
+		return NULL;
 	}
-
-	Mix_HaltMusic();
 }
 
 void Update(float elapsed) {
-	const Uint8 *keys = SDL_GetKeyboardState(NULL);
+	ProfileScope scope(PROFILE_UPDATE);
+	const Uint8 *keys = (inputKeys != NULL ? inputKeys : SDL_GetKeyboardState(NULL));
+
+	//remember where everything starts the step, so Render can interpolate toward where it ends up
+	world.previousPosition = world.position;
+
+	//start loading the next level as soon as it becomes reachable
+	const char *nextLevel = nextLevelFile();
+	if (nextLevel != NULL) {
+		levelLoader.Start(nextLevel);
+	}
 
 	switch (mode)
 	{
@@ -838,14 +3792,14 @@ void Update(float elapsed) {
 		if (keys[SDL_SCANCODE_SPACE]) {
 			SetupLevel("FinalMap_Outdoors.txt", bgm_outdoors);
 			mode = MODE_OUTDOORS;
-			//ParticleEmitters.push_back(*new ParticleEmitter(25, 3.0f, Player.position, glm::vec3(0.0f, 0.25f, 0.0f)));
+			//ParticleEmitters.Acquire()->Reset(25, 3.0f, Player.position, glm::vec3(0.0f, 0.25f, 0.0f));
 			//showPyrotechnics = true;
 		}
 		break;
 	case MODE_GAMEOVER:
 		if (keys[SDL_SCANCODE_SPACE]) {
 			SetupLevel("FinalMap_Exit.txt", bgm_exit);
-			Door.isLocked = false;
+			UnlockDoors();
 			mode = MODE_EXIT;
 		}
 		break;
@@ -856,165 +3810,32 @@ void Update(float elapsed) {
 		}
 		break;
 	default:
-		//Update Player
-
-	//every frame
-		Player.acceleration = glm::vec3(0.0f, 0.0f, 0.0f);
-		Player.Animate(elapsed);
-
-		//move left and right
-		if (!Player.collidedLeft && keys[SDL_SCANCODE_LEFT]) {
-			Player.acceleration[0] = -1.5f;
-			Player.facingRight = false;
-		}
-		else if (!Player.collidedRight && keys[SDL_SCANCODE_RIGHT]) {
-			Player.acceleration[0] = 1.5f;
-			Player.facingRight = true;
-		}
-
-		//jump
-		if (Player.collidedBottom && keys[SDL_SCANCODE_SPACE]) {
-			Player.velocity[1] = 2.0f;
-			Mix_PlayChannel(-1, jump, 0);
-		}
-
-		//apply gravity if off ground
-		if (!Player.collidedBottom) {
-			Player.acceleration[1] += -2.0f;
-		}
-
-		//do work on y-axis
-		Player.UpdateY(elapsed);
-		HandleTilemapCollisionY(Player);
-
-		//do work on x-axis
-		Player.UpdateX(elapsed);
-		HandleTilemapCollisionX(Player);
-
-		//Update Key 
-		if (mode == MODE_OUTDOORS) {
-			if (Key.IsColliding(Player)) {
-				Mix_PlayChannel(-1, pickup, 0);
-				Key.position[0] = -100.0f;
-				Door.isLocked = false;
-				showTemporary = false;
-				Key.isStatic = true;
-			}
-			if (!Key.isStatic) {
-				//every frame
-				Key.acceleration = glm::vec3(0.0f, 0.0f, 0.0f);
-
-				//gravity
-				if (!Key.collidedBottom) {
-					Key.acceleration[1] = -0.7f;
-				}
-				//do work on y-axis
-				Key.UpdateY(elapsed);
-				HandleTilemapCollisionY(Key);
-
-				//x-axis
-				Key.UpdateX(elapsed);
-				HandleTilemapCollisionX(Key);
-			}
-		}
-
-		//Update Point of Interest (show text if near it)
-		if (PointOfInterest.IsColliding(Player)) {
-			showFlavorText = true;
-			switch (mode) {
-			case MODE_OUTDOORS:
-				flavorText = "What a terrible sign!";
-				break;
-			case MODE_STORE:
-				flavorText = (showOverlay ? "I can't see a thing! (Press UP to light torch)" : "Woah, it's lit in here!");
-				if (keys[SDL_SCANCODE_UP]) {
-					showOverlay = false;
-					showTemporary = false;
-					showPyrotechnics = true;
-					Door.isLocked = false;
-				}
-				break;
-			case MODE_EXIT:
-				flavorText = "If I get to close to that bee's turf, he'll come after me.";
-				break;
-			default:
-				break;
-			}
-		}
-
-		//Update Door
-		if (Door.IsColliding(Player)) {
-			showFlavorText = true;
-			flavorText = (Door.isLocked ? "It's locked." : "Press UP to proceed.");
-			if (!Door.isLocked && keys[SDL_SCANCODE_UP]) {
-				switch (mode) {
-				case MODE_OUTDOORS:
-					ExitLevel();
-					glClearColor(0.6f, 0.41961f, 0.29f, 1.0f);
-					mode = MODE_STORE;
-					/*for (int i = 0; i < 4; i++) {
-						ParticleEmitters.push_back(*new ParticleEmitter(15, 3.0f, glm::vec3((float)i, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
-					} */
-					SetupLevel("FinalMap_Store.txt", bgm_store);
-					break;
-				case MODE_STORE:
-					ExitLevel();
-					glClearColor(0.05f, 0.46f, 0.8f, 1.0f);
-					mode = MODE_EXIT;
-					SetupLevel("FinalMap_Exit.txt", bgm_exit);
-					Door.isLocked = false;
-					break;
-				case MODE_EXIT:
-					ExitLevel();
-					mode = MODE_VICTORY;
-					break;
-				}
-			}
-		}
-
-		//both
-		if (!Door.IsColliding(Player) && !PointOfInterest.IsColliding(Player)) {
+		AnimationSystem(elapsed);
+		GravitySystem();
+		PlayerInputSystem(keys);
+		MovementSystem(elapsed);
+		PickupSystem();
+		SignSystem(keys);
+		DoorSystem(keys);
+		//the last door ends the game instead of loading a level
+		if (currentMap == NULL) { break; }
+
+		if (!PlayerTouching(COMPONENT_DOOR | COMPONENT_SIGN)) {
 			showFlavorText = false;
 			ribbited = false;
 		}
-
-		//Update enemy 
-		if (mode == MODE_EXIT) {
-			Enemy.isAngry = (abs(Enemy.resetPos[0] - Player.position[0]) < 1.0f);
-			if (Enemy.isAngry) {
-				Enemy.velocity[0] = (Enemy.position[0] - Player.position[0] < 0.0f ? 0.25f : -0.25f);
-				Enemy.velocity[1] = (Enemy.position[1] - Player.position[1] < 0.0f ? 0.25f : -0.25f);
-			}
-			else if (abs(Enemy.resetPos[0] - Enemy.position[0]) > 0.2f || abs(Enemy.resetPos[1] - Enemy.position[1]) > 0.2f) {
-				Enemy.velocity[0] = (Enemy.position[0] - Enemy.resetPos[0] < 0.0f ? 1.0f : -1.0f);
-				Enemy.velocity[1] = (Enemy.position[1] - Enemy.resetPos[1] < 0.0f ? 1.0f : -1.0f);
-			}
-			else {
-				Enemy.velocity[0] = 0.0f;
-				Enemy.velocity[1] = 0.0f;
-			}
-			//move
-			Enemy.position[0] += Enemy.velocity[0] * elapsed;
-			Enemy.position[1] += Enemy.velocity[1] * elapsed;
-
-			//apply random jitters
-			float randPercentX = (float)((rand() % 201) - 100) / 100.0f;
-			float randPercentY = (float)((rand() % 201) - 100) / 100.0f;
-			Enemy.position[0] += 0.01 * randPercentX;
-			Enemy.position[1] += 0.01 * randPercentY;
-
-			Enemy.facingRight = Enemy.velocity[0] >= 0.0f;
-
-			if (Enemy.IsColliding(Player)) {
-				ExitLevel();
-				mode = MODE_GAMEOVER;
-				break;
-			}
+		if (showFlavorText && !ribbited) {
+			Mix_PlayChannel(-1, ribbit, 0);
+			ribbited = true;
 		}
 
+		ChaserSystem(elapsed);
+		if (currentMap == NULL) { break; }
+
 		if (showPyrotechnics = true) {
-			for (int i = 0; i < ParticleEmitters.size(); i++) {
-				ParticleEmitters[i].Update(elapsed);
+			ProfileScope particleScope(PROFILE_PARTICLES);
+			for (int i = 0; i < ParticleEmitters.Count(); i++) {
+				ParticleEmitters.Live(i).Update(elapsed);
 			}
 		}
 		break;
@@ -1023,97 +3844,714 @@ void Update(float elapsed) {
 	
 }
 
-void renderLevelVector(float* levelVertexVector, float* levelTexCoordVector, int size, ShaderProgram &program) {
-	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 0, levelVertexVector);
-	glEnableVertexAttribArray(program.positionAttribute);
-
-	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 0, levelTexCoordVector);
-	glEnableVertexAttribArray(program.texCoordAttribute);
-
-	glDrawArrays(GL_TRIANGLES, 0, size);
-	glDisableVertexAttribArray(program.positionAttribute);
-	glDisableVertexAttribArray(program.texCoordAttribute);
-}
+void Render(ShaderProgram &program, const RenderSnapshot &snapshot, float alpha) {
+	//kept as strings so queuing them every frame doesn't allocate
+	static const string titleText = "The Big Beautiful Frog in their FINAL Adventure";
+	static const string startText = "Press Space to Begin";
+	static const string gameOverText = "GAME OVER";
+	static const string retryText = "Press Space to Retry or ESC to Exit";
+	static const string victoryText = "Congratulations!";
+	static const string playAgainText = "Press Space to Play Again or ESC to Exit";
 
-void Render(ShaderProgram &program) {
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 	program.SetModelMatrix(modelMatrix);
-	switch (mode) {
+	switch (snapshot.mode) {
 	case MODE_START:
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(-1.6f, 0.0f, 0.0f));
-		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "The Big Beautiful Frog in their FINAL Adventure", 0.1f, -0.05f);
+		textRenderer.Add(titleText, 0.1f, -0.05f, modelMatrix);
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -0.15f, 0.0f));
-		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "Press Space to Begin", 0.1f, -0.05f);
+		textRenderer.Add(startText, 0.1f, -0.05f, modelMatrix);
 		break;
 	case MODE_GAMEOVER:
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(-0.45f, 0.0f, 0.0f));
-		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "GAME OVER", 0.1f, 0.0f);
+		textRenderer.Add(gameOverText, 0.1f, 0.0f, modelMatrix);
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(-0.5f, -0.15f, 0.0f));
-		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "Press Space to Retry or ESC to Exit", 0.1f, -0.05f);
+		textRenderer.Add(retryText, 0.1f, -0.05f, modelMatrix);
 		break;
 	case MODE_VICTORY:
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(-0.5f, 0.0f, 0.0f));
-		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "Congratulations!", 0.1f, -0.05f);
+		textRenderer.Add(victoryText, 0.1f, -0.05f, modelMatrix);
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(-0.5f, -0.15f, 0.0f));
-		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "Press Space to Play Again or ESC to Exit", 0.1f, -0.05f);
+		textRenderer.Add(playAgainText, 0.1f, -0.05f, modelMatrix);
 		break;
 	default:
 		//draw level
-		glBindTexture(GL_TEXTURE_2D, tilesTexture);
+		glBindTexture(GL_TEXTURE_2D, tilesRegion.textureID);
 
-		renderLevelVector(level_vertexData.data(), level_texCoordData.data(), level_vertexData.size(), program);
-		if (showOverlay) { renderLevelVector(overlay_vertexData.data(), overlay_texCoordData.data(), overlay_vertexData.size(), program); }
-		if (showTemporary) { renderLevelVector(temporary_vertexData.data(), temporary_texCoordData.data(), temporary_vertexData.size(), program); }
+		float viewLeft, viewRight, viewBottom, viewTop;
+		getViewBounds(snapshot, alpha, &viewLeft, &viewRight, &viewBottom, &viewTop);
+		levelBuffer.Draw(program, viewLeft, viewRight, viewBottom, viewTop);
+		if (snapshot.showOverlay) { overlayBuffer.Draw(program, viewLeft, viewRight, viewBottom, viewTop); }
+		if (snapshot.showTemporary) { temporaryBuffer.Draw(program, viewLeft, viewRight, viewBottom, viewTop); }
 
 		//draw visible entities
+		spriteBatch.Begin();
 
-		//player
-		Player.Draw(program);
-
-		//Draw Key if we havent moved it offscreen
-		if (mode == MODE_OUTDOORS && Key.position[0] > 0) {
-			Key.Draw(program);
-		}
-
-		//Draw bee if were in the last stage
-		if (mode == MODE_EXIT) {
-			Enemy.Draw(program);
-		}
+		DrawSystem(spriteBatch, snapshot, alpha);
+		quadProgram.Bind();
+		spriteBatch.Flush(quadProgram, quadRenderer);
+		program.Bind();
 
 		//Draw Level's Flavor text
-		if (showFlavorText) {
+		if (snapshot.showFlavorText) {
 			modelMatrix = glm::mat4(1.0f);
-			glm::vec3 textPos = getCameraPos();
+			glm::vec3 textPos = getCameraPos(snapshot, alpha);
 			textPos[0] = -textPos[0] - 1.6f;
 			textPos[1] = -textPos[1] - 0.9f;
 			modelMatrix = glm::translate(modelMatrix, textPos);
-			program.SetModelMatrix(modelMatrix);
-			DrawText(program, fontTexture, flavorText, 0.1f, -0.05f);
-			if (!ribbited) { Mix_PlayChannel(-1, ribbit, 0); }
-			ribbited = true;
+			textRenderer.Add(snapshot.flavorText, 0.1f, -0.05f, viewMatrix * modelMatrix);
 		}
 
 		//Fiyah
-		if (showPyrotechnics) {
-			glUseProgram(pointProgram.programID);
-			for (int i = 0; i < ParticleEmitters.size(); i++) {
-				ParticleEmitters[i].Render(pointProgram);
-			}
-			glUseProgram(program.programID);
+		if (snapshot.showPyrotechnics && !snapshot.particles.empty()) {
+			ProfileScope particleScope(PROFILE_PARTICLES);
+			quadProgram.Bind();
+			quadRenderer.Upload(snapshot.particles.data(), (int)snapshot.particles.size());
+			quadRenderer.Begin(quadProgram);
+			quadRenderer.Draw(0, 0, (int)snapshot.particles.size());
+			quadRenderer.End();
+			program.Bind();
 		}
 		break;
 	}
 }
 
+//scripted key input for --headless runs. each line is a step count followed by the keys held for those
+//steps, joined with '+' using SDL key names ("120 Right+Space"); "-" holds nothing. the script loops
+class InputScript {
+public:
+	bool Load(const char *path);
+	const Uint8 *Step();
+
+	class Segment {
+	public:
+		int steps;
+		vector<SDL_Scancode> keys;
+	};
+
+	vector<Segment> segments;
+	int segmentIndex;
+	int segmentStep;
+	Uint8 keys[SDL_NUM_SCANCODES];
+};
+
+bool InputScript::Load(const char *path) {
+	ifstream infile(path);
+	if (!infile) { return false; }
+	segments.clear();
+	string line;
+	while (getline(infile, line)) {
+		istringstream lineStream(line);
+		Segment segment;
+		string keyNames;
+		if (!(lineStream >> segment.steps) || segment.steps <= 0) { continue; }
+		lineStream >> keyNames;
+		istringstream keyStream(keyNames);
+		string keyName;
+		while (getline(keyStream, keyName, '+')) {
+			if (keyName.empty() || keyName == "-") { continue; }
+			SDL_Scancode scancode = SDL_GetScancodeFromName(keyName.c_str());
+			if (scancode == SDL_SCANCODE_UNKNOWN) {
+				cout << "Unknown key " << keyName << " in " << path << "\n";
+				return false;
+			}
+			segment.keys.push_back(scancode);
+		}
+		segments.push_back(segment);
+	}
+	segmentIndex = 0;
+	segmentStep = 0;
+	return !segments.empty();
+}
+
+const Uint8 *InputScript::Step() {
+	if (segmentStep >= segments[segmentIndex].steps) {
+		segmentStep = 0;
+		segmentIndex = (segmentIndex + 1) % segments.size();
+	}
+	segmentStep++;
+	memset(keys, 0, sizeof(keys));
+	for (int i = 0; i < (int)segments[segmentIndex].keys.size(); i++) {
+		keys[segments[segmentIndex].keys[i]] = 1;
+	}
+	return keys;
+}
+
+//the keys Update reads, one bit each in a recorded step
+const SDL_Scancode recordedKeys[] = { SDL_SCANCODE_SPACE, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT, SDL_SCANCODE_UP };
+#define RECORDED_KEY_COUNT 4
+
+//"FREC" in a little-endian file
+#define RECORDING_MAGIC 0x43455246
+#define RECORDING_VERSION 1
+
+struct RecordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seed;
+	uint32_t stepCount;
+};
+
+//per-fixed-step key state plus the rand() seed of a session, so it can be played back exactly
+class InputRecording {
+public:
+	InputRecording();
+
+	bool Load(const char *path);
+	bool Save(const char *path) const;
+
+	void Record(const Uint8 *liveKeys);
+	const Uint8 *Play();
+
+	uint32_t seed;
+	vector<uint8_t> steps;
+	int playhead;
+	Uint8 keys[SDL_NUM_SCANCODES];
+};
+
+InputRecording::InputRecording() {
+	seed = 0;
+	playhead = 0;
+}
+
+bool InputRecording::Load(const char *path) {
+	ifstream infile(path, ios::binary);
+	RecordingHeader header;
+	if (!infile.read((char*)&header, sizeof(header))) { return false; }
+	if (header.magic != RECORDING_MAGIC || header.version != RECORDING_VERSION) { return false; }
+	seed = header.seed;
+	steps.resize(header.stepCount);
+	if (header.stepCount > 0 && !infile.read((char*)steps.data(), header.stepCount)) { return false; }
+	playhead = 0;
+	return true;
+}
+
+bool InputRecording::Save(const char *path) const {
+	ofstream outfile(path, ios::binary | ios::trunc);
+	RecordingHeader header = { RECORDING_MAGIC, RECORDING_VERSION, seed, (uint32_t)steps.size() };
+	outfile.write((const char*)&header, sizeof(header));
+	if (!steps.empty()) { outfile.write((const char*)steps.data(), steps.size()); }
+	return (bool)outfile;
+}
+
+void InputRecording::Record(const Uint8 *liveKeys) {
+	uint8_t packed = 0;
+	for (int i = 0; i < RECORDED_KEY_COUNT; i++) {
+		if (liveKeys[recordedKeys[i]]) { packed |= (1 << i); }
+	}
+	steps.push_back(packed);
+}
+
+//the key state for the next step, or NULL once the recording has run out
+const Uint8 *InputRecording::Play() {
+	if (playhead >= (int)steps.size()) { return NULL; }
+	memset(keys, 0, sizeof(keys));
+	for (int i = 0; i < RECORDED_KEY_COUNT; i++) {
+		keys[recordedKeys[i]] = (steps[playhead] >> i) & 1;
+	}
+	playhead++;
+	return keys;
+}
+
+//FNV-1a
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+	const unsigned char *bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t hashEntity(uint64_t hash, EntityID entity) {
+	hash = hashBytes(hash, &world.mask[entity], sizeof(unsigned int));
+	hash = hashBytes(hash, &world.position[entity][0], 3 * sizeof(float));
+	hash = hashBytes(hash, &world.velocity[entity][0], 3 * sizeof(float));
+	unsigned char flags[3] = { world.collided[entity], world.isLocked[entity], world.isAngry[entity] };
+	hash = hashBytes(hash, flags, sizeof(flags));
+	return hashBytes(hash, &world.animFrame[entity], sizeof(int));
+}
+
+//everything Update changes, so a replay can be checked against the session it was recorded from
+uint64_t HashGameState() {
+	uint64_t hash = 14695981039346656037ull;
+	int modeValue = mode;
+	hash = hashBytes(hash, &modeValue, sizeof(modeValue));
+	for (EntityID entity = 0; entity < world.Count(); entity++) {
+		if (world.mask[entity] != 0) { hash = hashEntity(hash, entity); }
+	}
+	bool flags[4] = { showOverlay, showTemporary, showPyrotechnics, showFlavorText };
+	hash = hashBytes(hash, flags, sizeof(flags));
+	for (int i = 0; i < ParticleEmitters.Count(); i++) {
+		const ParticleEmitter &emitter = ParticleEmitters.Live(i);
+		if (emitter.capacity > 0) { hash = hashBytes(hash, emitter.x, emitter.capacity * 5 * sizeof(float)); }
+	}
+	return hash;
+}
+
+//--bench-jobs: time gravity, integration and tile collision for many bodies dropped on a map, from 1 thread up to
+//maxThreads, and check that every thread count leaves them in the same state
+void BenchmarkJobs(const char *mapFile, int entityCount, int maxThreads) {
+	LevelMap *map = new LevelMap();
+	if (!loadMap(mapFile, *map)) {
+		cout << "Unable to load map " << mapFile << "\n";
+		delete map;
+		return;
+	}
+	map->BuildCollision(tileProperties);
+	currentMap = map;
+
+	srand(1);
+	vector<glm::vec3> startPositions(entityCount);
+	vector<float> startSpeeds(entityCount);
+	for (int i = 0; i < entityCount; i++) {
+		startPositions[i] = glm::vec3((rand() % (map->width * 100)) / 100.0f * TILE_SIZE, -(rand() % (map->height * 100)) / 100.0f * TILE_SIZE, 0.0f);
+		startSpeeds[i] = (float)((rand() % 201) - 100) / 100.0f;
+	}
+
+	const int steps = 60;
+	double serialTime = 0.0;
+	cout << entityCount << " bodies x " << steps << " steps on " << mapFile << "\n";
+	for (int threads = 1; threads <= maxThreads; threads++) {
+		jobs.workerCount = threads - 1;
+		jobs.Start();
+		world.Clear();
+		for (int i = 0; i < entityCount; i++) {
+			EntityID entity = world.Create(COMPONENT_BODY, startPositions[i], glm::vec3(0.16f, 0.16f, 1.0f));
+			world.velocity[entity][0] = startSpeeds[i];
+			world.gravity[entity] = -2.0f;
+		}
+
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		for (int step = 0; step < steps; step++) {
+			GravitySystem();
+			MovementSystem(FIXED_TIMESTEP);
+		}
+		double time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		if (threads == 1) { serialTime = time; }
+
+		uint64_t hash = 14695981039346656037ull;
+		for (EntityID entity = 0; entity < world.Count(); entity++) {
+			hash = hashEntity(hash, entity);
+		}
+		cout << threads << " threads: " << time / steps << " ms/step, " << serialTime / time << "x, state hash " << hex << hash << dec << "\n";
+	}
+
+	jobs.Stop();
+	world.Clear();
+	currentMap = NULL;
+	delete map;
+}
+
+//the images must already have been decoded by assets.Start/Finish; this only packs and uploads them
+void LoadSprites() {
+	int fontImage = assets.AddToAtlas(spriteAtlas, "font");
+	int beeImage = assets.AddToAtlas(spriteAtlas, "bee");
+	int playerImage = assets.AddToAtlas(spriteAtlas, "player");
+	int keyImage = assets.AddToAtlas(spriteAtlas, "key");
+	int tilesImage = assets.AddToAtlas(spriteAtlas, "tiles");
+	spriteAtlas.Build();
+	fontRegion = spriteAtlas.GetRegion(fontImage);
+	beeRegion = spriteAtlas.GetRegion(beeImage);
+	playerRegion = spriteAtlas.GetRegion(playerImage);
+	keyRegion = spriteAtlas.GetRegion(keyImage);
+	tilesRegion = spriteAtlas.GetRegion(tilesImage);
+	textRenderer.SetFont(fontRegion);
+}
+
+//F3: frame time percentiles and per-stage averages over the last PROFILE_HISTORY frames, in ms.
+//the numbers change every frame, so they go through AddGlyphs rather than the layout cache
+void DrawProfilerOverlay() {
+	char lines[5][96];
+	snprintf(lines[0], sizeof(lines[0]), "frame %.2f p50 %.2f p99 %.2f", profiler.AverageStageTime(PROFILE_FRAME),
+		profiler.FrameTimePercentile(50.0f), profiler.FrameTimePercentile(99.0f));
+	snprintf(lines[1], sizeof(lines[1]), "update %.3f collision %.3f", profiler.AverageStageTime(PROFILE_UPDATE),
+		profiler.AverageStageTime(PROFILE_COLLISION));
+	snprintf(lines[2], sizeof(lines[2]), "render %.3f text %.3f particles %.3f", profiler.AverageStageTime(PROFILE_RENDER),
+		profiler.AverageStageTime(PROFILE_TEXT), profiler.AverageStageTime(PROFILE_PARTICLES));
+	const ShaderStateStats &shaderStats = ShaderProgram::stats;
+	unsigned long long skipped = shaderStats.useProgramSkipped + shaderStats.uniformSkipped;
+	unsigned long long made = shaderStats.useProgramCalls + shaderStats.uniformCalls;
+	snprintf(lines[3], sizeof(lines[3]), "shader calls skipped %.1f%%", 100.0 * skipped / max(skipped + made, 1ULL));
+	snprintf(lines[4], sizeof(lines[4]), "cpu %.0f%% jitter %.2f vsync %s", 100.0f * pacer.recentCpuUse, pacer.Jitter(), (pacer.vsync ? "on" : "off"));
+
+	for (int i = 0; i < 5; i++) {
+		glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-VIEW_HALF_WIDTH + 0.05f, VIEW_HALF_HEIGHT - 0.05f - 0.07f * i, 0.0f));
+		textRenderer.AddGlyphs(lines[i], 0.05f, -0.02f, modelMatrix);
+	}
+}
+
+//the clear color last given to GL; starts out of range so the first frame sets it
+glm::vec3 appliedClearColor(-1.0f, -1.0f, -1.0f);
+
+//swaps the tile buffers over to the snapshot's level, uploading the layers SetupLevel left for it
+void UploadPendingLevel(int generation) {
+	if (generation == uploadedLevelGeneration) { return; }
+	levelBuffer.Cleanup();
+	overlayBuffer.Cleanup();
+	temporaryBuffer.Cleanup();
+
+	//the simulation may already be on a later level; its layers wait for a snapshot of it
+	lock_guard<mutex> guard(pendingLevel.lock);
+	if (pendingLevel.generation == generation) {
+		levelBuffer.Upload(pendingLevel.layers[0]);
+		overlayBuffer.Upload(pendingLevel.layers[1]);
+		temporaryBuffer.Upload(pendingLevel.layers[2]);
+		for (int i = 0; i < MAP_FILE_LAYERS; i++) {
+			pendingLevel.layers[i].Clear();
+		}
+	}
+	uploadedLevelGeneration = generation;
+}
+
+//alpha is how far the frame is between the snapshot's last step and the next one
+void RenderFrame(const RenderSnapshot &snapshot, float alpha) {
+	if (snapshot.clearColor != appliedClearColor) {
+		glClearColor(snapshot.clearColor[0], snapshot.clearColor[1], snapshot.clearColor[2], 1.0f);
+		appliedClearColor = snapshot.clearColor;
+	}
+	glClear(GL_COLOR_BUFFER_BIT);
+	UploadPendingLevel(snapshot.levelGeneration);
+
+	viewMatrix = glm::mat4(1.0f);
+	if (snapshot.mode == MODE_OUTDOORS || snapshot.mode == MODE_STORE || snapshot.mode == MODE_EXIT) {
+		viewMatrix = glm::translate(viewMatrix, getCameraPos(snapshot, alpha));
+	}
+	program.SetViewMatrix(viewMatrix);
+	quadProgram.SetViewMatrix(viewMatrix);
+	{
+		ProfileScope scope(PROFILE_RENDER);
+		Render(program, snapshot, alpha);
+	}
+	if (showProfiler) { DrawProfilerOverlay(); }
+
+	//text is queued in screen space, so it all goes out in one draw on top of the frame
+	program.SetViewMatrix(glm::mat4(1.0f));
+	textRenderer.Flush(program);
+}
+
+//--headless: step the game as fast as possible from an input script or a --record file,
+//rendering through the null backend. a recording is always played to its end
+int RunHeadless(int steps, const char *inputFile, const char *traceFile) {
+#ifdef NULL_RENDERER
+	InputScript script;
+	InputRecording recording;
+	bool replaying = recording.Load(inputFile);
+	if (replaying) {
+		steps = (int)recording.steps.size();
+	}
+	else if (!script.Load(inputFile)) {
+		cout << "Unable to load input script " << inputFile << "\n";
+		return 1;
+	}
+
+	if (!assets.Start(RESOURCE_FOLDER"assets.txt", false)) {
+		cout << "Unable to load asset manifest. Make sure the path is correct\n";
+		return 1;
+	}
+	projectionMatrix = glm::ortho(-VIEW_HALF_WIDTH, VIEW_HALF_WIDTH, -VIEW_HALF_HEIGHT, VIEW_HALF_HEIGHT, -1.0f, 1.0f);
+	program.Load(RESOURCE_FOLDER"vertex_textured.glsl", RESOURCE_FOLDER"fragment_textured.glsl");
+	quadProgram.Load(RESOURCE_FOLDER"vertex.glsl", RESOURCE_FOLDER"fragment.glsl");
+	program.SetProjectionMatrix(projectionMatrix);
+	quadProgram.SetProjectionMatrix(projectionMatrix);
+	assets.Finish();
+	LoadSprites();
+	cout << "assets decoded in " << assets.decodeTime << " ms on " << assets.workerCount << " threads\n";
+
+	mode = MODE_START;
+	srand(replaying ? recording.seed : 1);
+	NullRendererStats setupStats = nullRendererStats();
+	ShaderStateStats setupShaderStats = ShaderProgram::stats;
+	profiler.lastFrameEnd = profiler.Now();
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int step = 0; step < steps; step++) {
+		inputKeys = (replaying ? recording.Play() : script.Step());
+		Update(FIXED_TIMESTEP);
+		frameSnapshot.Capture();
+		RenderFrame(frameSnapshot, 1.0f);
+		profiler.EndFrame();
+	}
+	double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+	inputKeys = NULL;
+
+	NullRendererStats stats = nullRendererStats();
+	cout << steps << " steps in " << seconds << " s: " << steps / seconds << " steps/s\n";
+	cout << "per step: " << (double)(stats.drawCalls - setupStats.drawCalls) / steps << " draw calls, "
+		<< (double)(stats.calls - setupStats.calls) / steps << " GL calls, "
+		<< (double)(stats.bytesUploaded - setupStats.bytesUploaded) / steps << " bytes uploaded\n";
+	ShaderStateStats shaderStats = ShaderProgram::stats;
+	cout << "per step: " << (double)(shaderStats.useProgramSkipped - setupShaderStats.useProgramSkipped) / steps << " glUseProgram and "
+		<< (double)(shaderStats.uniformSkipped - setupShaderStats.uniformSkipped) / steps << " glUniform calls skipped, "
+		<< (double)(shaderStats.useProgramCalls - setupShaderStats.useProgramCalls) / steps << " and "
+		<< (double)(shaderStats.uniformCalls - setupShaderStats.uniformCalls) / steps << " made\n";
+	cout << "final mode " << mode << ", ";
+	if (playerEntity != NO_ENTITY) { cout << "player at " << world.position[playerEntity][0] << ", " << world.position[playerEntity][1] << "\n"; }
+	else { cout << "no player\n"; }
+	cout << "state hash " << hex << HashGameState() << dec << "\n";
+	if (traceFile != NULL && !profiler.WriteTrace(traceFile)) {
+		cout << "Unable to write trace " << traceFile << "\n";
+	}
+
+	if (currentMap != NULL) { ExitLevel(); }
+	levelLoader.Cancel();
+	jobs.Stop();
+	levelBuffer.Cleanup();
+	overlayBuffer.Cleanup();
+	temporaryBuffer.Cleanup();
+	quadRenderer.Cleanup();
+	textRenderer.Cleanup();
+	spriteAtlas.Cleanup();
+	assets.Cleanup();
+	return 0;
+#else
+	(void)steps;
+	(void)inputFile;
+	(void)traceFile;
+	cout << "--headless needs a build with NULL_RENDERER defined\n";
+	return 1;
+#endif
+}
+
+//--bench-text: a static menu plus a line of flavor text, queued and flushed every frame through the null backend
+int BenchmarkText(int frames) {
+#ifdef NULL_RENDERER
+	static const string lines[3] = { "The Big Beautiful Frog in their FINAL Adventure", "Press Space to Begin", "I can't see a thing! (Press UP to light torch)" };
+	glm::mat4 matrices[3];
+	for (int i = 0; i < 3; i++) {
+		matrices[i] = glm::translate(glm::mat4(1.0f), glm::vec3(-1.6f, -0.15f * i, 0.0f));
+	}
+
+	//the first frame lays out the strings and sizes the buffers
+	for (int i = 0; i < 3; i++) { textRenderer.Add(lines[i], 0.1f, -0.05f, matrices[i]); }
+	textRenderer.Flush(program);
+
+	size_t allocationsBefore = countedAllocations;
+	NullRendererStats statsBefore = nullRendererStats();
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		for (int i = 0; i < 3; i++) { textRenderer.Add(lines[i], 0.1f, -0.05f, matrices[i]); }
+		textRenderer.Flush(program);
+	}
+	double total = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+	NullRendererStats stats = nullRendererStats();
+
+	cout << frames << " frames: " << total / frames << " us/frame, "
+		<< (double)(countedAllocations - allocationsBefore) / frames << " allocations/frame, "
+		<< (double)(stats.drawCalls - statsBefore.drawCalls) / frames << " draw calls/frame, "
+		<< (double)(stats.bytesUploaded - statsBefore.bytesUploaded) / frames << " bytes uploaded/frame\n";
+	textRenderer.Cleanup();
+	return 0;
+#else
+	(void)frames;
+	cout << "--bench-text needs a build with NULL_RENDERER defined\n";
+	return 1;
+#endif
+}
+
+//--sim-thread: Update runs on its own thread at the fixed rate and publishes a snapshot after every step,
+//while the main thread polls events and draws whichever snapshot is newest
+class SimulationThread {
+public:
+	SimulationThread();
+	~SimulationThread();
+
+	void Start(InputRecording *recording_in, bool replaying_in, bool recordInput_in);
+	void Stop();
+	//main thread: the keys Update should see from the next step on
+	void SetKeys(const Uint8 *liveKeys);
+	//how far the newest snapshot is toward the step after it
+	float Alpha() const;
+
+	SnapshotBuffer snapshots;
+	//set once a replay runs out of input
+	atomic<bool> finished;
+
+private:
+	void Run();
+
+	thread worker;
+	atomic<bool> running;
+	mutex keyLock;
+	Uint8 sharedKeys[SDL_NUM_SCANCODES];
+	Uint8 stepKeys[SDL_NUM_SCANCODES];
+	InputRecording *recording;
+	bool replaying;
+	bool recordInput;
+};
+
+SimulationThread::SimulationThread() {
+	finished = false;
+	running = false;
+	memset(sharedKeys, 0, sizeof(sharedKeys));
+	memset(stepKeys, 0, sizeof(stepKeys));
+	recording = NULL;
+	replaying = false;
+	recordInput = false;
+}
+
+SimulationThread::~SimulationThread() {
+	Stop();
+}
+
+void SimulationThread::Start(InputRecording *recording_in, bool replaying_in, bool recordInput_in) {
+	recording = recording_in;
+	replaying = replaying_in;
+	recordInput = recordInput_in;
+	finished = false;
+
+	//something to draw before the first step lands
+	snapshots.WriteSlot().Capture();
+	snapshots.Publish();
+	snapshots.Acquire();
+
+	running = true;
+	worker = thread([this]() { Run(); });
+}
+
+void SimulationThread::Stop() {
+	running = false;
+	if (worker.joinable()) { worker.join(); }
+	inputKeys = NULL;
+}
+
+void SimulationThread::SetKeys(const Uint8 *liveKeys) {
+	lock_guard<mutex> guard(keyLock);
+	memcpy(sharedKeys, liveKeys, sizeof(sharedKeys));
+}
+
+float SimulationThread::Alpha() const {
+	double sinceStep = profiler.Now() - snapshots.ReadSlot().time;
+	return (float)min(max(sinceStep / (FIXED_TIMESTEP * 1000000.0), 0.0), 1.0);
+}
+
+void SimulationThread::Run() {
+	profiler.SetSimulationThread();
+	chrono::microseconds stepLength((long long)(FIXED_TIMESTEP * 1000000.0f));
+	chrono::steady_clock::time_point nextStep = chrono::steady_clock::now();
+	while (running) {
+		this_thread::sleep_until(nextStep);
+		nextStep += stepLength;
+		//after a long stall drop the backlog instead of racing through it
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - nextStep > 5 * stepLength) { nextStep = now; }
+
+		if (replaying) {
+			inputKeys = recording->Play();
+			if (inputKeys == NULL) {
+				finished = true;
+				return;
+			}
+		}
+		else {
+			{
+				lock_guard<mutex> guard(keyLock);
+				memcpy(stepKeys, sharedKeys, sizeof(stepKeys));
+			}
+			if (recordInput) { recording->Record(stepKeys); }
+			inputKeys = stepKeys;
+		}
+		Update(FIXED_TIMESTEP);
+
+		snapshots.WriteSlot().Capture();
+		snapshots.Publish();
+	}
+}
+
 int main(int argc, char *argv[])
 {
+	chrono::high_resolution_clock::time_point launchTime = chrono::high_resolution_clock::now();
+	if (argc > 1 && string(argv[1]) == "--convert-maps") {
+		ConvertMaps(argc - 2, argv + 2);
+		return 0;
+	}
+	if (argc > 1 && string(argv[1]) == "--bench-maps") {
+		BenchmarkMapLoading(argc - 2, argv + 2);
+		return 0;
+	}
+	if (argc > 1 && string(argv[1]) == "--bench-text") {
+		return BenchmarkText(argc > 2 ? atoi(argv[2]) : 10000);
+	}
+	if (argc > 1 && string(argv[1]) == "--bench-particles") {
+		BenchmarkParticles(argc > 2 ? atoi(argv[2]) : 100000);
+		return 0;
+	}
+	if (!tileProperties.Load(RESOURCE_FOLDER"tiles_spritesheet_plus.tsx")) {
+		cout << "Unable to load tileset properties. Make sure the path is correct\n";
+		assert(false);
+	}
+	if (argc > 2 && string(argv[1]) == "--bench-collision") {
+		BenchmarkTileCollision(argv[2], (argc > 3 ? atoi(argv[3]) : 10000));
+		return 0;
+	}
+	if (argc > 2 && string(argv[1]) == "--bench-jobs") {
+		unsigned int cores = thread::hardware_concurrency();
+		BenchmarkJobs(argv[2], (argc > 3 ? atoi(argv[3]) : 50000), (argc > 4 ? atoi(argv[4]) : max((int)cores, 1)));
+		return 0;
+	}
+	//--trace <file> writes a Chrome trace of the last PROFILE_MAX_EVENTS timed stages on exit
+	const char *traceFile = NULL;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (string(argv[i]) == "--trace") { traceFile = argv[i + 1]; }
+	}
+	if (traceFile != NULL) { profiler.EnableTrace(); }
+
+	//--asset-workers <n> overrides the decode pool size, --job-workers <n> the threads helping Update,
+	//--time-startup reports time to first frame and quits after it. --no-vsync paces frames by sleeping,
+	//--fps <n> sets that rate, --frame-stats reports CPU use and frame jitter on exit
+	bool timeStartup = false;
+	bool hotReload = false;
+	bool simThread = false;
+	bool allowVsync = true;
+	int targetFPS = 60;
+	bool frameStats = false;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--asset-workers" && i + 1 < argc) { assets.workerCount = atoi(argv[i + 1]); }
+		if (string(argv[i]) == "--job-workers" && i + 1 < argc) { jobs.workerCount = atoi(argv[i + 1]); }
+		if (string(argv[i]) == "--time-startup") { timeStartup = true; }
+		if (string(argv[i]) == "--hot-reload") { hotReload = true; }
+		if (string(argv[i]) == "--sim-thread") { simThread = true; }
+		if (string(argv[i]) == "--no-vsync") { allowVsync = false; }
+		if (string(argv[i]) == "--fps" && i + 1 < argc) { targetFPS = atoi(argv[i + 1]); }
+		if (string(argv[i]) == "--frame-stats") { frameStats = true; }
+	}
+	if (simThread && hotReload) {
+		cout << "--hot-reload edits the level from the main thread, running the simulation there too\n";
+		simThread = false;
+	}
+
+	jobs.Start();
+
+	if (argc > 1 && string(argv[1]) == "--headless") {
+		return RunHeadless((argc > 2 ? atoi(argv[2]) : 36000), (argc > 3 ? argv[3] : RESOURCE_FOLDER"headless_input.txt"), traceFile);
+	}
+
+	//--record <file> saves this session's input and seed, --replay <file> plays one back and quits at its end
+	InputRecording recording;
+	const char *recordFile = NULL;
+	bool replaying = false;
+	if (argc > 2 && string(argv[1]) == "--record") {
+		recordFile = argv[2];
+	}
+	else if (argc > 2 && string(argv[1]) == "--replay") {
+		if (!recording.Load(argv[2])) {
+			cout << "Unable to load recording " << argv[2] << "\n";
+			return 1;
+		}
+		replaying = true;
+	}
+
     SDL_Init(SDL_INIT_VIDEO);
+
+	//audio is opened first so the workers can decode sounds into the device format while the window and shaders are set up.
+	//the MP3 decoder is initialized here rather than by whichever worker loads the first song
+	Mix_Init(MIX_INIT_MP3);
+	Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 4096);
+	if (!assets.Start(RESOURCE_FOLDER"assets.txt", true)) {
+		cout << "Unable to load asset manifest. Make sure the path is correct\n";
+		assert(false);
+	}
+
     displayWindow = SDL_CreateWindow("tBBF6: The Final Adventure", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 720, SDL_WINDOW_OPENGL);
     SDL_GLContext context = SDL_GL_CreateContext(displayWindow);
     SDL_GL_MakeCurrent(displayWindow, context);
@@ -1123,34 +4561,29 @@ int main(int argc, char *argv[])
 #endif
 
 	glViewport(0, 0, 1280, 720);
+	pacer.Setup(allowVsync, targetFPS);
 
-	projectionMatrix = glm::ortho(-1.777f, 1.777f, -1.0f, 1.0f, -1.0f, 1.0f);
+	projectionMatrix = glm::ortho(-VIEW_HALF_WIDTH, VIEW_HALF_WIDTH, -VIEW_HALF_HEIGHT, VIEW_HALF_HEIGHT, -1.0f, 1.0f);
 
 	program.Load(RESOURCE_FOLDER"vertex_textured.glsl", RESOURCE_FOLDER"fragment_textured.glsl");
-	pointProgram.Load(RESOURCE_FOLDER"vertex.glsl", RESOURCE_FOLDER"fragment.glsl");
+	quadProgram.Load(RESOURCE_FOLDER"vertex.glsl", RESOURCE_FOLDER"fragment.glsl");
 	
 	program.SetProjectionMatrix(projectionMatrix);
-	pointProgram.SetProjectionMatrix(projectionMatrix);
-	pointProgram.SetModelMatrix(glm::mat4(1.0f));
+	quadProgram.SetProjectionMatrix(projectionMatrix);
+	quadProgram.SetModelMatrix(glm::mat4(1.0f));
 
-	glClearColor(0.05f, 0.46f, 0.8f, 1.0f);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 4096);
+	assets.Finish();
+	LoadSprites();
 
-	fontTexture = LoadTextureNearest(RESOURCE_FOLDER"font_spritesheet.png");
-	beeTexture = LoadTextureNearest(RESOURCE_FOLDER"bee.png");
-	playerTexture = LoadTextureNearest(RESOURCE_FOLDER"frog.png");
-	keyTexture = LoadTextureNearest(RESOURCE_FOLDER"keyYellow.png");
-	tilesTexture = LoadTextureNearest(RESOURCE_FOLDER"tiles_spritesheet_plus2.png");
-
-	pickup = Mix_LoadWAV(RESOURCE_FOLDER"coinPickup.wav");
-	jump = Mix_LoadWAV(RESOURCE_FOLDER"jump.wav");
-	ribbit = Mix_LoadWAV(RESOURCE_FOLDER"ribbit.wav");
-	bgm_outdoors = Mix_LoadMUS(RESOURCE_FOLDER"bgm.mp3");
-	bgm_store = Mix_LoadMUS(RESOURCE_FOLDER"bgm_store.mp3");
-	bgm_exit = Mix_LoadMUS(RESOURCE_FOLDER"bgm_exit.mp3");
+	pickup = assets.Sound("pickup");
+	jump = assets.Sound("jump");
+	ribbit = assets.Sound("ribbit");
+	bgm_outdoors = assets.Music("outdoors");
+	bgm_store = assets.Music("store");
+	bgm_exit = assets.Music("exit");
 	
 	Mix_VolumeMusic(15);
 
@@ -1158,56 +4591,129 @@ int main(int argc, char *argv[])
 
 	mode = MODE_START;
 
-	srand(time(NULL));
+	if (!replaying) { recording.seed = (uint32_t)time(NULL); }
+	srand(recording.seed);
+
+	FileWatcher watcher;
+	if (hotReload) {
+		watcher.Watch(program.vertexShaderPath);
+		watcher.Watch(program.fragmentShaderPath);
+		watcher.Watch(quadProgram.vertexShaderPath);
+		watcher.Watch(quadProgram.fragmentShaderPath);
+		watcher.Watch(RESOURCE_FOLDER"FinalMap_Outdoors.txt");
+		watcher.Watch(RESOURCE_FOLDER"FinalMap_Store.txt");
+		watcher.Watch(RESOURCE_FOLDER"FinalMap_Exit.txt");
+	}
+
+	int frames = 0;
+	chrono::high_resolution_clock::time_point sessionStart = chrono::high_resolution_clock::now();
+	profiler.lastFrameEnd = profiler.Now();
+
+	SimulationThread simulation;
+	if (simThread) { simulation.Start(&recording, replaying, recordFile != NULL); }
+
+	//the mode of the last frame drawn; the title and end screens only change on input
+	gameMode shownMode = MODE_START;
 
     SDL_Event event;
     bool done = false;
     while (!done) {
+		pacer.Wait(shownMode == MODE_START || shownMode == MODE_GAMEOVER || shownMode == MODE_VICTORY);
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT || event.type == SDL_WINDOWEVENT_CLOSE) {
                 done = true;
 			}
-			else if (event.type == SDL_KEYDOWN) {
+			else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+				pacer.NoteInput();
+			}
+			if (event.type == SDL_KEYDOWN) {
 				if (event.key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
 					done = true;
 				}
+				else if (event.key.keysym.scancode == SDL_SCANCODE_F3) {
+					showProfiler = !showProfiler;
+				}
 			}
         }
-        glClear(GL_COLOR_BUFFER_BIT);
-
-		float ticks = (float)SDL_GetTicks() / 1000.0f;
-		float elapsed = ticks - lastFrameTicks;
-		lastFrameTicks = ticks;
-
-		elapsed += acc;
-		if (elapsed < FIXED_TIMESTEP) {
-			acc = elapsed;
-			continue;
-		}
-		while (elapsed >= FIXED_TIMESTEP) {
-			Update(FIXED_TIMESTEP);
-			elapsed -= FIXED_TIMESTEP;
+		if (hotReload) { HotReload(watcher); }
+
+		if (simThread) {
+			simulation.SetKeys(SDL_GetKeyboardState(NULL));
+			if (simulation.finished) { done = true; }
+			simulation.snapshots.Acquire();
+			RenderFrame(simulation.snapshots.ReadSlot(), simulation.Alpha());
+			shownMode = simulation.snapshots.ReadSlot().mode;
 		}
-		acc = elapsed;
+		else {
+			float ticks = (float)SDL_GetTicks() / 1000.0f;
+			float elapsed = ticks - lastFrameTicks;
+			lastFrameTicks = ticks;
+
+			elapsed += acc;
+			while (elapsed >= FIXED_TIMESTEP) {
+				if (replaying) {
+					inputKeys = recording.Play();
+					if (inputKeys == NULL) {
+						done = true;
+						break;
+					}
+				}
+				else if (recordFile != NULL) {
+					recording.Record(SDL_GetKeyboardState(NULL));
+				}
+				Update(FIXED_TIMESTEP);
+				elapsed -= FIXED_TIMESTEP;
+			}
+			acc = elapsed;
 
-		viewMatrix = glm::mat4(1.0f);
-		if (mode == MODE_OUTDOORS || mode == MODE_STORE || mode == MODE_EXIT) {
-			viewMatrix = glm::translate(viewMatrix, getCameraPos());
+			//frames between steps draw the last one partway between where it started and ended
+			frameSnapshot.Capture();
+			RenderFrame(frameSnapshot, acc / FIXED_TIMESTEP);
+			shownMode = frameSnapshot.mode;
 		}
-		program.SetViewMatrix(viewMatrix);
-		pointProgram.SetViewMatrix(viewMatrix);
-		Render(program);
+		frames++;
 
         SDL_GL_SwapWindow(displayWindow);
+		profiler.EndFrame();
+
+		if (timeStartup && frames == 1) {
+			double startupTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - launchTime).count();
+			cout << "first frame after " << startupTime << " ms, assets decoded in " << assets.decodeTime << " ms on "
+				<< assets.workerCount << " threads\n";
+			done = true;
+		}
     }
+	simulation.Stop();
+
+	if (frameStats) {
+		cout << frames << " frames, vsync " << (pacer.vsync ? "on" : "off") << ", cpu " << 100.0f * pacer.SessionCpuUse()
+			<< "% of one core, frame interval " << pacer.MeanFrameTime() << " ms, jitter " << pacer.Jitter() << " ms\n";
+	}
+	if (traceFile != NULL) {
+		cout << "frame time p50 " << profiler.FrameTimePercentile(50.0f) << " ms, p99 " << profiler.FrameTimePercentile(99.0f) << " ms\n";
+		if (!profiler.WriteTrace(traceFile)) { cout << "Unable to write trace " << traceFile << "\n"; }
+	}
+
+	if (recordFile != NULL || replaying) {
+		double sessionTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - sessionStart).count();
+		cout << recording.steps.size() << " steps, " << frames << " frames, " << sessionTime / max(frames, 1) << " ms/frame\n";
+		cout << "state hash " << hex << HashGameState() << dec << "\n";
+	}
+	if (recordFile != NULL && !recording.Save(recordFile)) {
+		cout << "Unable to save recording " << recordFile << "\n";
+	}
 
-	Mix_FreeChunk(jump);
-	Mix_FreeChunk(pickup);
-	Mix_FreeChunk(ribbit);
-	Mix_FreeMusic(bgm_outdoors);
-	Mix_FreeMusic(bgm_store);
-	Mix_FreeMusic(bgm_exit);
+	levelLoader.Cancel();
+	jobs.Stop();
+	levelBuffer.Cleanup();
+	overlayBuffer.Cleanup();
+	temporaryBuffer.Cleanup();
+	quadRenderer.Cleanup();
+	textRenderer.Cleanup();
+	spriteAtlas.Cleanup();
+	assets.Cleanup();
     
+    Mix_Quit();
     SDL_Quit();
     return 0;
 }
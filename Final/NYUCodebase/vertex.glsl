@@ -1,15 +1,26 @@
 attribute vec4 position;
-attribute vec4 color;
+attribute vec2 texCoord;
+
+//per instance: x, y, width, height
+attribute vec4 instanceRect;
+//per instance: left, bottom, right, top
+attribute vec4 instanceUV;
+attribute vec4 startColor;
+attribute vec4 endColor;
+attribute float fade;
 
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
 
+varying vec2 texCoordVar;
 varying vec4 vertexColor;
 
 void main()
 {
-	vec4 p = viewMatrix * modelMatrix  * position;
-	vertexColor = color;
+	vec4 corner = vec4(instanceRect.xy + position.xy * instanceRect.zw, 0.0, 1.0);
+	vec4 p = viewMatrix * modelMatrix  * corner;
+	texCoordVar = mix(instanceUV.xy, instanceUV.zw, texCoord);
+	vertexColor = mix(startColor, endColor, fade);
 	gl_Position = projectionMatrix * p;
 }
\ No newline at end of file
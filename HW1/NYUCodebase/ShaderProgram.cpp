@@ -1,25 +1,82 @@
 
 #include "ShaderProgram.h"
 
+GLuint ShaderProgram::boundProgram = 0;
+ShaderStateStats ShaderProgram::stats = { 0, 0, 0, 0 };
+
 void ShaderProgram::Load(const char *vertexShaderFile, const char *fragmentShaderFile) {
     
+	vertexShaderPath = vertexShaderFile;
+	fragmentShaderPath = fragmentShaderFile;
+
     // create the vertex shader
     vertexShader = LoadShaderFromFile(vertexShaderFile, GL_VERTEX_SHADER);
     // create the fragment shader
     fragmentShader = LoadShaderFromFile(fragmentShaderFile, GL_FRAGMENT_SHADER);
     
     // Create the final shader program from our vertex and fragment shaders
-    programID = glCreateProgram();
-    glAttachShader(programID, vertexShader);
-    glAttachShader(programID, fragmentShader);
-    glLinkProgram(programID);
-    
-    GLint linkSuccess;
-    glGetProgramiv(programID, GL_LINK_STATUS, &linkSuccess);
-    if(linkSuccess == GL_FALSE) {
+    if(!LinkProgram(vertexShader, fragmentShader, programID)) {
 	printf("Error linking shader program!\n");
     }
     
+	GetLocations();
+	ResetUniformCache();
+	SetColor(1.0f, 1.0f, 1.0f, 1.0f);
+    
+}
+
+//recompiles from the files Load was given. if either stage fails to compile or the program fails to link,
+//the old program is kept and false is returned
+bool ShaderProgram::Reload() {
+	GLuint newVertexShader = LoadShaderFromFile(vertexShaderPath, GL_VERTEX_SHADER);
+	GLuint newFragmentShader = LoadShaderFromFile(fragmentShaderPath, GL_FRAGMENT_SHADER);
+	GLuint newProgramID;
+	if (!LinkProgram(newVertexShader, newFragmentShader, newProgramID)) {
+		glDeleteProgram(newProgramID);
+		glDeleteShader(newVertexShader);
+		glDeleteShader(newFragmentShader);
+		return false;
+	}
+
+	//carry the uniform values over to the new program
+	glm::mat4 oldModelMatrix = modelMatrix;
+	glm::mat4 oldProjectionMatrix = projectionMatrix;
+	glm::mat4 oldViewMatrix = viewMatrix;
+	float oldColor[4] = { color[0], color[1], color[2], color[3] };
+	bool hadModelMatrix = modelMatrixSet;
+	bool hadProjectionMatrix = projectionMatrixSet;
+	bool hadViewMatrix = viewMatrixSet;
+
+	Cleanup();
+	programID = newProgramID;
+	vertexShader = newVertexShader;
+	fragmentShader = newFragmentShader;
+	GetLocations();
+	ResetUniformCache();
+
+	SetColor(oldColor[0], oldColor[1], oldColor[2], oldColor[3]);
+	if (hadModelMatrix) { SetModelMatrix(oldModelMatrix); }
+	if (hadProjectionMatrix) { SetProjectionMatrix(oldProjectionMatrix); }
+	if (hadViewMatrix) { SetViewMatrix(oldViewMatrix); }
+	return true;
+}
+
+//linking fails if either shader failed to compile
+bool ShaderProgram::LinkProgram(GLuint vertexShaderID, GLuint fragmentShaderID, GLuint &linkedProgramID) {
+    linkedProgramID = glCreateProgram();
+	if (boundProgram == linkedProgramID) {
+		boundProgram = 0;
+	}
+    glAttachShader(linkedProgramID, vertexShaderID);
+    glAttachShader(linkedProgramID, fragmentShaderID);
+    glLinkProgram(linkedProgramID);
+    
+    GLint linkSuccess;
+    glGetProgramiv(linkedProgramID, GL_LINK_STATUS, &linkSuccess);
+    return linkSuccess != GL_FALSE;
+}
+
+void ShaderProgram::GetLocations() {
     modelMatrixUniform = glGetUniformLocation(programID, "modelMatrix");
     projectionMatrixUniform = glGetUniformLocation(programID, "projectionMatrix");
     viewMatrixUniform = glGetUniformLocation(programID, "viewMatrix");
@@ -27,12 +84,12 @@ void ShaderProgram::Load(const char *vertexShaderFile, const char *fragmentShade
     
     positionAttribute = glGetAttribLocation(programID, "position");
     texCoordAttribute = glGetAttribLocation(programID, "texCoord");
-	
-	SetColor(1.0f, 1.0f, 1.0f, 1.0f);
-    
 }
 
 void ShaderProgram::Cleanup() {
+	if (boundProgram == programID) {
+		boundProgram = 0;
+	}
     glDeleteProgram(programID);
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
@@ -83,22 +140,71 @@ GLuint ShaderProgram::LoadShaderFromString(const std::string &shaderContents, GL
     return shaderID;
 }
 
-void ShaderProgram::SetColor(float r, float g, float b, float a) {
+void ShaderProgram::ResetUniformCache() {
+	modelMatrixSet = false;
+	projectionMatrixSet = false;
+	viewMatrixSet = false;
+	colorSet = false;
+}
+
+void ShaderProgram::Bind() {
+	if (boundProgram == programID) {
+		stats.useProgramSkipped++;
+		return;
+	}
 	glUseProgram(programID);
+	boundProgram = programID;
+	stats.useProgramCalls++;
+}
+
+//the setters always leave this program bound, as they did before the cache, so draws that follow still use it
+void ShaderProgram::SetColor(float r, float g, float b, float a) {
+	Bind();
+	if (colorSet && color[0] == r && color[1] == g && color[2] == b && color[3] == a) {
+		stats.uniformSkipped++;
+		return;
+	}
 	glUniform4f(colorUniform, r, g, b, a);
+	color[0] = r;
+	color[1] = g;
+	color[2] = b;
+	color[3] = a;
+	colorSet = true;
+	stats.uniformCalls++;
 }
 
 void ShaderProgram::SetViewMatrix(const glm::mat4 &matrix) {
-    glUseProgram(programID);
+	Bind();
+	if (viewMatrixSet && viewMatrix == matrix) {
+		stats.uniformSkipped++;
+		return;
+	}
     glUniformMatrix4fv(viewMatrixUniform, 1, GL_FALSE, &matrix[0][0]);
+	viewMatrix = matrix;
+	viewMatrixSet = true;
+	stats.uniformCalls++;
 }
 
 void ShaderProgram::SetModelMatrix(const glm::mat4 &matrix) {
-    glUseProgram(programID);
+	Bind();
+	if (modelMatrixSet && modelMatrix == matrix) {
+		stats.uniformSkipped++;
+		return;
+	}
     glUniformMatrix4fv(modelMatrixUniform, 1, GL_FALSE, &matrix[0][0]);
+	modelMatrix = matrix;
+	modelMatrixSet = true;
+	stats.uniformCalls++;
 }
 
 void ShaderProgram::SetProjectionMatrix(const glm::mat4 &matrix) {
-    glUseProgram(programID);
-    glUniformMatrix4fv(projectionMatrixUniform, 1, GL_FALSE, &matrix[0][0]);    
+	Bind();
+	if (projectionMatrixSet && projectionMatrix == matrix) {
+		stats.uniformSkipped++;
+		return;
+	}
+    glUniformMatrix4fv(projectionMatrixUniform, 1, GL_FALSE, &matrix[0][0]);
+	projectionMatrix = matrix;
+	projectionMatrixSet = true;
+	stats.uniformCalls++;
 }
@@ -5,6 +5,7 @@
 #include <SDL_opengl.h>
 #include <SDL_image.h>
 #include "ShaderProgram.h"
+#include "TextureCache.h"
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #define STB_IMAGE_IMPLEMENTATION
@@ -18,27 +19,6 @@
 
 SDL_Window* displayWindow;
 
-GLuint LoadTexture(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		std::cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	stbi_image_free(image);
-	return retTexture;
-}
-
 int main(int argc, char *argv[])
 {
     SDL_Init(SDL_INIT_VIDEO);
@@ -58,6 +38,11 @@ int main(int argc, char *argv[])
 	ShaderProgram program1;
 	program1.Load(RESOURCE_FOLDER"vertex.glsl", RESOURCE_FOLDER"fragment.glsl");
 
+	TextureCache textures;
+	TextureHandle frogTexture = textures.Load(RESOURCE_FOLDER"frog.png", TEXTURE_NEAREST);
+	TextureHandle beeTexture = textures.Load(RESOURCE_FOLDER"bee.png", TEXTURE_NEAREST);
+	TextureHandle ghostTexture = textures.Load(RESOURCE_FOLDER"ghost.png", TEXTURE_NEAREST);
+
 	glm::mat4 projectionMatrix = glm::mat4(1.0f);
 	projectionMatrix = glm::ortho(-1.777f, 1.777f, -1.0f, 1.0f, -1.0f, 1.0f);
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
@@ -91,7 +76,7 @@ int main(int argc, char *argv[])
 			scaleDirection *= -1.0f;
 		}
 
-		glUseProgram(program0.programID);
+		program0.Bind();
 		program0.SetProjectionMatrix(projectionMatrix);
 		program0.SetViewMatrix(viewMatrix);
 
@@ -102,7 +87,7 @@ int main(int argc, char *argv[])
 		
 		program0.SetModelMatrix(modelMatrix);
 
-		GLuint frogTexture = LoadTexture(RESOURCE_FOLDER"frog.png");
+		glBindTexture(GL_TEXTURE_2D, frogTexture.textureID);
 
 		float vertices0[] = { -0.37f, -0.25f, 0.37f, -0.25f, 0.37f, 0.25f, -0.37f, -0.25f, 0.37f, 0.25f, -0.37f, 0.25f };
 		glVertexAttribPointer(program0.positionAttribute, 2, GL_FLOAT, false, 0, vertices0);
@@ -125,7 +110,7 @@ int main(int argc, char *argv[])
 		glDisableVertexAttribArray(program0.texCoordAttribute);
 
 		//drawing bee
-		GLuint beeTexture = LoadTexture(RESOURCE_FOLDER"bee.png");
+		glBindTexture(GL_TEXTURE_2D, beeTexture.textureID);
 
 		modelMatrix = glm::mat4(1.0f);
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(-1.5f, 0.4f, 0.0f));
@@ -145,7 +130,7 @@ int main(int argc, char *argv[])
 		glDisableVertexAttribArray(program0.texCoordAttribute);
 
 		//drawing ghost
-		GLuint ghostTexture = LoadTexture(RESOURCE_FOLDER"ghost.png");
+		glBindTexture(GL_TEXTURE_2D, ghostTexture.textureID);
 
 		modelMatrix = glm::mat4(1.0f);
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(1.25f, 0.4f, 0.0f));
@@ -163,7 +148,7 @@ int main(int argc, char *argv[])
 		glDisableVertexAttribArray(program0.positionAttribute);
 		glDisableVertexAttribArray(program0.texCoordAttribute);
 
-		glUseProgram(program1.programID); //switching to untextured polygons
+		program1.Bind(); //switching to untextured polygons
 		program1.SetProjectionMatrix(projectionMatrix);
 		program1.SetViewMatrix(viewMatrix);
 		program1.SetColor(0.41f, 0.25f, 0.12f, 1.0f); //tree brown
@@ -209,6 +194,8 @@ int main(int argc, char *argv[])
         SDL_GL_SwapWindow(displayWindow);
     }
     
+	textures.Cleanup();
+    
     SDL_Quit();
     return 0;
 }
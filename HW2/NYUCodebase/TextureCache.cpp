@@ -0,0 +1,151 @@
+#include "TextureCache.h"
+#include "stb_image.h"
+#include <iostream>
+#include <cassert>
+
+TextureHandle::TextureHandle() {
+	textureID = 0;
+	cache = NULL;
+	slot = -1;
+	generation = 0;
+}
+
+TextureHandle::TextureHandle(const TextureHandle &other) {
+	textureID = other.textureID;
+	cache = other.cache;
+	slot = other.slot;
+	generation = other.generation;
+	if (cache != NULL) { cache->AddReference(slot, generation); }
+}
+
+TextureHandle &TextureHandle::operator=(const TextureHandle &other) {
+	if (this == &other) { return *this; }
+	if (other.cache != NULL) { other.cache->AddReference(other.slot, other.generation); }
+	Release();
+	textureID = other.textureID;
+	cache = other.cache;
+	slot = other.slot;
+	generation = other.generation;
+	return *this;
+}
+
+TextureHandle::~TextureHandle() {
+	Release();
+}
+
+void TextureHandle::Release() {
+	if (cache != NULL) { cache->RemoveReference(slot, generation); }
+	textureID = 0;
+	cache = NULL;
+	slot = -1;
+}
+
+TextureCache::TextureCache() {
+	liveTextures = 0;
+	textureBytes = 0;
+	decodes = 0;
+	nextGeneration = 1;
+}
+
+TextureHandle TextureCache::Load(const std::string &filePath, TextureFilter filter) {
+	std::string key = filePath + (filter == TEXTURE_NEAREST ? "#nearest" : "#linear");
+	std::unordered_map<std::string, int>::iterator found = slots.find(key);
+
+	TextureHandle handle;
+	if (found != slots.end()) {
+		Entry &entry = entries[found->second];
+		entry.references++;
+		handle.textureID = entry.textureID;
+		handle.cache = this;
+		handle.slot = found->second;
+		handle.generation = entry.generation;
+		return handle;
+	}
+
+	int w, h, comp;
+	unsigned char* image = stbi_load(filePath.c_str(), &w, &h, &comp, STBI_rgb_alpha);
+	if (image == NULL) {
+		std::cout << "Unable to load image. Make sure the path is correct\n";
+		assert(false);
+	}
+	decodes++;
+
+	GLuint retTexture;
+	glGenTextures(1, &retTexture);
+	glBindTexture(GL_TEXTURE_2D, retTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+
+	GLint filterMode = (filter == TEXTURE_NEAREST ? GL_NEAREST : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filterMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filterMode);
+
+	stbi_image_free(image);
+
+	int slot;
+	if (!freeSlots.empty()) {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		slot = (int)entries.size();
+		entries.push_back(Entry());
+	}
+	Entry &entry = entries[slot];
+	entry.key = key;
+	entry.textureID = retTexture;
+	entry.references = 1;
+	entry.bytes = (size_t)w * h * 4;
+	entry.generation = nextGeneration++;
+	slots[key] = slot;
+
+	liveTextures++;
+	textureBytes += entry.bytes;
+
+	handle.textureID = retTexture;
+	handle.cache = this;
+	handle.slot = slot;
+	handle.generation = entry.generation;
+	return handle;
+}
+
+void TextureCache::AddReference(int slot, unsigned int generation) {
+	if (slot < 0 || slot >= (int)entries.size() || entries[slot].generation != generation) { return; }
+	entries[slot].references++;
+}
+
+void TextureCache::RemoveReference(int slot, unsigned int generation) {
+	if (slot < 0 || slot >= (int)entries.size() || entries[slot].generation != generation) { return; }
+	Entry &entry = entries[slot];
+	entry.references--;
+	if (entry.references > 0) { return; }
+
+	glDeleteTextures(1, &entry.textureID);
+	liveTextures--;
+	textureBytes -= entry.bytes;
+	slots.erase(entry.key);
+	entry.generation = 0;
+	freeSlots.push_back(slot);
+}
+
+int TextureCache::LiveTextures() const {
+	int count = 0;
+	for (int i = 0; i < (int)entries.size(); i++) {
+		if (entries[i].generation != 0) { count++; }
+	}
+	return count;
+}
+
+//deletes every texture still loaded. handles that outlive this become no-ops
+void TextureCache::Cleanup() {
+	for (int i = 0; i < (int)entries.size(); i++) {
+		if (entries[i].generation != 0) {
+			glDeleteTextures(1, &entries[i].textureID);
+			entries[i].generation = 0;
+		}
+	}
+	entries.clear();
+	freeSlots.clear();
+	slots.clear();
+	liveTextures = 0;
+	textureBytes = 0;
+}
@@ -5,11 +5,14 @@
 #include <SDL_opengl.h>
 #include <SDL_image.h>
 #include "ShaderProgram.h"
+#include "TextureCache.h"
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <ctime>
+#include <string>
+#include <iostream>
 
 #ifdef _WINDOWS
 #define RESOURCE_FOLDER ""
@@ -19,48 +22,6 @@
 
 SDL_Window* displayWindow;
 
-GLuint LoadTextureNearest(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		std::cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	stbi_image_free(image);
-	return retTexture;
-}
-
-GLuint LoadTextureLinear(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		std::cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	stbi_image_free(image);
-	return retTexture;
-}
-
 float frogScale = 1.0f;
 float frogXPosition = 0.0f;
 float frogYPosition = 0.0f;
@@ -77,6 +38,9 @@ glm::mat4 viewMatrix = glm::mat4(1.0f);
 
 ShaderProgram program0, program1;
 
+TextureCache textures;
+TextureHandle lilypadTexture, frogTexture;
+
 float getFrogAngle() {
 	float angleMod = (float)(rand() % 30 + 1) / 100.0f;
 	return angleMod * 3.1415926f;
@@ -151,12 +115,12 @@ void determinePolygonPositions(float elapsed) {
 }
 
 void drawTexturedPolygons() {
-	glUseProgram(program0.programID);
+	program0.Bind();
 	program0.SetProjectionMatrix(projectionMatrix);
 	program0.SetViewMatrix(viewMatrix);
 
 	//drawing left lilypad (player)
-	GLuint beeTexture = LoadTextureLinear(RESOURCE_FOLDER"lilypad.png");
+	glBindTexture(GL_TEXTURE_2D, lilypadTexture.textureID);
 
 	modelMatrix = glm::mat4(1.0f);
 	modelMatrix = glm::translate(modelMatrix, glm::vec3(-1.77f, playerPosition, 0.0f));
@@ -175,7 +139,6 @@ void drawTexturedPolygons() {
 	glDisableVertexAttribArray(program0.texCoordAttribute);
 
 	//drawing right lilypad (CPU)
-	GLuint ghostTexture = LoadTextureLinear(RESOURCE_FOLDER"lilypad.png");
 
 	modelMatrix = glm::mat4(1.0f);
 	modelMatrix = glm::translate(modelMatrix, glm::vec3(1.77f, CPUPosition, 0.0f));
@@ -194,7 +157,7 @@ void drawTexturedPolygons() {
 	glDisableVertexAttribArray(program0.texCoordAttribute);
 
 	//draw the frog
-	GLuint frogTexture = LoadTextureNearest(RESOURCE_FOLDER"frog.png");
+	glBindTexture(GL_TEXTURE_2D, frogTexture.textureID);
 
 	modelMatrix = glm::mat4(1.0f);
 	modelMatrix = glm::translate(modelMatrix, glm::vec3(frogXPosition, frogYPosition, 0.0f));
@@ -215,7 +178,7 @@ void drawTexturedPolygons() {
 }
 
 void drawUntexturedPolygons() {
-	glUseProgram(program1.programID); //switching to untextured polygons
+	program1.Bind(); //switching to untextured polygons
 	program1.SetProjectionMatrix(projectionMatrix);
 	program1.SetViewMatrix(viewMatrix);
 	program1.SetColor(0.08f, 0.49f, 0.2f, 1.0f); //seaweed
@@ -267,6 +230,26 @@ void highlyAdvancedArtificialIntelligence() {
 	prevFrameDirection = frogXDirection;
 }
 
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
+//free video memory in KB, from GL_NVX_gpu_memory_info or GL_ATI_meminfo; -1 when the driver has neither
+int freeVideoMemory() {
+	//the ATI query fills in four values, the first of which is the total free
+	GLint memory[4] = { -1, -1, -1, -1 };
+	if (SDL_GL_ExtensionSupported("GL_NVX_gpu_memory_info")) {
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, memory);
+	}
+	else if (SDL_GL_ExtensionSupported("GL_ATI_meminfo")) {
+		glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, memory);
+	}
+	return memory[0];
+}
+
 int main(int argc, char *argv[])
 {
     SDL_Init(SDL_INIT_VIDEO);
@@ -287,6 +270,26 @@ int main(int argc, char *argv[])
 	program0.Load(RESOURCE_FOLDER"vertex_textured.glsl", RESOURCE_FOLDER"fragment_textured.glsl");
 	program1.Load(RESOURCE_FOLDER"vertex.glsl", RESOURCE_FOLDER"fragment.glsl");
 
+	lilypadTexture = textures.Load(RESOURCE_FOLDER"lilypad.png", TEXTURE_LINEAR);
+	frogTexture = textures.Load(RESOURCE_FOLDER"frog.png", TEXTURE_NEAREST);
+
+	//--soak [frames]: play uncapped for a number of frames and check the cache's textures never grow, and that GL
+	//agrees: the loaded textures stay valid and no texture appears past them. free video memory is reported
+	//alongside where the driver exposes it
+	int soakFrames = 0;
+	if (argc > 1 && std::string(argv[1]) == "--soak") {
+		soakFrames = (argc > 2 ? atoi(argv[2]) : 216000);
+		SDL_GL_SetSwapInterval(0);
+	}
+	int startTextures = textures.LiveTextures();
+	//drivers hand out texture names in increasing order, so a texture made outside the cache would take this one
+	GLuint probeTexture = (lilypadTexture.textureID > frogTexture.textureID ? lilypadTexture.textureID : frogTexture.textureID) + 1;
+	size_t startBytes = textures.textureBytes;
+	int startVideoMemory = (soakFrames > 0 ? freeVideoMemory() : -1);
+	if (startVideoMemory >= 0) { std::cout << "0 frames: " << startVideoMemory << " KB video memory free\n"; }
+	int frames = 0;
+	bool soakFailed = false;
+
 	glClearColor(0.05f, 0.46f, 0.73f, 1.0f);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -314,8 +317,29 @@ int main(int argc, char *argv[])
 		drawTexturedPolygons();
 
         SDL_GL_SwapWindow(displayWindow);
+
+		if (soakFrames > 0) {
+			frames++;
+			if (textures.LiveTextures() != startTextures || textures.textureBytes != startBytes) { soakFailed = true; }
+			if (!glIsTexture(lilypadTexture.textureID) || !glIsTexture(frogTexture.textureID) || glIsTexture(probeTexture)) { soakFailed = true; }
+			if (frames % 3600 == 0 || frames == soakFrames) {
+				std::cout << frames << " frames: " << textures.LiveTextures() << " textures, " << textures.textureBytes
+					<< " bytes, " << textures.decodes << " decodes";
+				if (startVideoMemory >= 0) { std::cout << ", " << freeVideoMemory() << " KB video memory free"; }
+				std::cout << "\n";
+			}
+			if (frames == soakFrames) { done = true; }
+		}
     }
+
+	lilypadTexture.Release();
+	frogTexture.Release();
+	textures.Cleanup();
     
     SDL_Quit();
+	if (soakFrames > 0) {
+		std::cout << (soakFailed ? "soak FAILED: texture memory grew\n" : "soak passed: texture memory flat\n");
+		return (soakFailed ? 1 : 0);
+	}
     return 0;
 }
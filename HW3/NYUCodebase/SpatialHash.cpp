@@ -0,0 +1,93 @@
+#include "SpatialHash.h"
+#include <cmath>
+
+SpatialHash::SpatialHash(float cellSize_in) {
+	cellSize = cellSize_in;
+	queryStamp = 0;
+	bucketMask = 0;
+}
+
+void SpatialHash::Clear() {
+	entries.clear();
+}
+
+int SpatialHash::CellCoordinate(float value) const {
+	return (int)floorf(value / cellSize);
+}
+
+uint32_t SpatialHash::CellHash(int cellX, int cellY) const {
+	return ((uint32_t)cellX * 73856093u) ^ ((uint32_t)cellY * 19349663u);
+}
+
+void SpatialHash::Insert(int index, float minX, float minY, float maxX, float maxY) {
+	Entry entry;
+	entry.index = index;
+	int lastX = CellCoordinate(maxX);
+	int lastY = CellCoordinate(maxY);
+	for (int y = CellCoordinate(minY); y <= lastY; y++) {
+		for (int x = CellCoordinate(minX); x <= lastX; x++) {
+			//masked down to a bucket once Build knows the table size
+			entry.bucket = CellHash(x, y);
+			entries.push_back(entry);
+		}
+	}
+}
+
+//counting sort of the entries by bucket, so each bucket's indices end up contiguous
+void SpatialHash::Build() {
+	uint32_t bucketCount = 64;
+	while (bucketCount < entries.size() * 2) { bucketCount *= 2; }
+	bucketMask = bucketCount - 1;
+
+	bucketStart.assign(bucketCount + 1, 0);
+	int maxIndex = -1;
+	for (size_t i = 0; i < entries.size(); i++) {
+		entries[i].bucket &= bucketMask;
+		bucketStart[entries[i].bucket + 1]++;
+		maxIndex = (entries[i].index > maxIndex ? entries[i].index : maxIndex);
+	}
+	for (uint32_t i = 0; i < bucketCount; i++) {
+		bucketStart[i + 1] += bucketStart[i];
+	}
+
+	sortedIndices.resize(entries.size());
+	for (size_t i = 0; i < entries.size(); i++) {
+		sortedIndices[bucketStart[entries[i].bucket]++] = entries[i].index;
+	}
+	//filling advanced each start to the next bucket's start, so shift them back
+	for (uint32_t i = bucketCount; i > 0; i--) {
+		bucketStart[i] = bucketStart[i - 1];
+	}
+	bucketStart[0] = 0;
+
+	if ((int)queryStamps.size() < maxIndex + 1) {
+		queryStamps.resize(maxIndex + 1, 0);
+	}
+}
+
+void SpatialHash::Query(float minX, float minY, float maxX, float maxY, std::vector<int> &candidates) {
+	candidates.clear();
+	if (sortedIndices.empty()) { return; }
+
+	//stamps dedupe indices that span several cells or share a bucket with another cell
+	queryStamp++;
+	if (queryStamp == 0) {
+		queryStamps.assign(queryStamps.size(), 0);
+		queryStamp = 1;
+	}
+
+	int lastX = CellCoordinate(maxX);
+	int lastY = CellCoordinate(maxY);
+	for (int y = CellCoordinate(minY); y <= lastY; y++) {
+		for (int x = CellCoordinate(minX); x <= lastX; x++) {
+			uint32_t bucket = CellHash(x, y) & bucketMask;
+			for (int i = bucketStart[bucket]; i < bucketStart[bucket + 1]; i++) {
+				int index = sortedIndices[i];
+				if (queryStamps[index] != queryStamp) {
+					queryStamps[index] = queryStamp;
+					candidates.push_back(index);
+				}
+			}
+		}
+	}
+}
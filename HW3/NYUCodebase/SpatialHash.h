@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//uniform grid broadphase. boxes are inserted into every cell they overlap, cells are hashed into a table
+//sized to the number of entries, and a query returns each inserted index whose cells it touches, once.
+//candidates still need a narrowphase test; rebuild with Clear/Insert/Build whenever the inserted boxes move
+class SpatialHash {
+    public:
+		SpatialHash(float cellSize_in);
+
+		void Clear();
+		void Insert(int index, float minX, float minY, float maxX, float maxY);
+		void Build();
+		void Query(float minX, float minY, float maxX, float maxY, std::vector<int> &candidates);
+
+		float cellSize;
+
+    private:
+		uint32_t CellHash(int cellX, int cellY) const;
+		int CellCoordinate(float value) const;
+
+		struct Entry {
+			uint32_t bucket;
+			int index;
+		};
+
+		std::vector<Entry> entries;
+		std::vector<int> bucketStart;
+		std::vector<int> sortedIndices;
+		std::vector<unsigned int> queryStamps;
+		unsigned int queryStamp;
+		uint32_t bucketMask;
+};
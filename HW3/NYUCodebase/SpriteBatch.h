@@ -0,0 +1,48 @@
+#pragma once
+
+#ifdef _WINDOWS
+	#include <GL/glew.h>
+#endif
+#include <SDL_opengl.h>
+#include <vector>
+#include "ShaderProgram.h"
+#include "glm/mat4x4.hpp"
+
+class SheetSprite {
+	public:
+		SheetSprite();
+		SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in);
+
+		float size;
+		GLuint textureID;
+		std::vector<float> indices;
+		unsigned int currAnimFrame;
+		float u;
+		float v;
+		float width;
+		float height;
+
+		void Animate();
+};
+
+//collects a frame's sprite quads, transformed on the CPU, and draws them with one draw call per texture
+class SpriteBatch {
+	public:
+		SpriteBatch();
+
+		void Begin();
+		void Add(const SheetSprite &sprite, const glm::mat4 &modelMatrix);
+		void Flush(ShaderProgram &program);
+		void Cleanup();
+
+		struct BatchedQuad {
+			GLuint textureID;
+			int order;
+		};
+
+		std::vector<BatchedQuad> quads;
+		std::vector<float> quadVertices;
+		std::vector<float> sortedVertices;
+		GLuint bufferID;
+		int drawCalls;
+};
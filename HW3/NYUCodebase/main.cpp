@@ -5,12 +5,20 @@
 #include <SDL_opengl.h>
 #include <SDL_image.h>
 #include "ShaderProgram.h"
+#include "TextureCache.h"
+#include "SpatialHash.h"
+#include "SpriteBatch.h"
+#include "ObjectPool.h"
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <ctime>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
 
 #ifdef _WINDOWS
 #define RESOURCE_FOLDER ""
@@ -21,32 +29,14 @@
 SDL_Window* displayWindow;
 
 
-class SheetSprite {
-	public:
-		SheetSprite();
-		SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in);
-
-		void Draw(ShaderProgram &program);
-
-		float size;
-		GLuint textureID;
-		std::vector<float> indices;
-		unsigned int currAnimFrame;
-		float u;
-		float v;
-		float width;
-		float height;
-
-		void Animate();
-};
-
 class Entity {
 	public:
 
-		void Draw(ShaderProgram &program);
+		void Draw(SpriteBatch &batch);
 		void Update(float elapsed);
 
 		bool IsColliding(Entity &entity);
+		void GetBounds(float *minX, float *minY, float *maxX, float *maxY);
 
 		glm::vec3 position;
 		glm::vec3 velocity;
@@ -61,65 +51,6 @@ class Entity {
 		float elapsedSinceLastAnim;
 };
 
-SheetSprite::SheetSprite() {
-	size = 1.0f;
-	textureID = 0;
-	u = 1.0f;
-	v = 1.0f;
-	width = 1.0f;
-	height = 1.0f;
-}
-
-SheetSprite::SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in) {
-	size = size_in;
-	textureID = textureID_in;
-	u = 0.0f;
-	v = 0.0f;
-	currAnimFrame = 0;
-	width = width_in;
-	height = height_in;
-}
-
-void SheetSprite::Draw(ShaderProgram &program) {
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	GLfloat texCoords[] = {
-		u, v + height,
-		u + width, v,
-		u, v,
-		u + width, v,
-		u, v + height,
-		u + width, v + height
-	};
-
-	float vertices[] = {
-		-0.5f * size, -0.5f * size,
-		0.5f * size, 0.5f * size,
-		-0.5f * size, 0.5f * size,
-		0.5f * size, 0.5f * size,
-		-0.5f * size, -0.5f * size,
-		0.5f * size, -0.5f * size,
-	};
-
-	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 0, vertices);
-	glEnableVertexAttribArray(program.positionAttribute);
-
-	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 0, texCoords);
-	glEnableVertexAttribArray(program.texCoordAttribute);
-
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisableVertexAttribArray(program.positionAttribute);
-	glDisableVertexAttribArray(program.texCoordAttribute);
-}
-
-void SheetSprite::Animate() {
-	u = indices[currAnimFrame];
-	v = indices[currAnimFrame + 1];
-	
-	currAnimFrame += 2;
-	if (currAnimFrame >= indices.size()) { currAnimFrame = 0; }
-}
-
 bool Entity::IsColliding(Entity &entity) {
 	float e1HalfWidth = (sprite.size * size[0]) / 2.0f;
 	float e1HalfHeight = (sprite.size * size[1]) / 2.0f;
@@ -130,6 +61,16 @@ bool Entity::IsColliding(Entity &entity) {
 	return (xOverlap && yOverlap);
 }
 
+//the box IsColliding tests against
+void Entity::GetBounds(float *minX, float *minY, float *maxX, float *maxY) {
+	float halfWidth = (sprite.size * size[0]) / 2.0f;
+	float halfHeight = (sprite.size * size[1]) / 2.0f;
+	*minX = position[0] - halfWidth;
+	*minY = position[1] - halfHeight;
+	*maxX = position[0] + halfWidth;
+	*maxY = position[1] + halfHeight;
+}
+
 void Entity::Update(float elapsed) {
 	if (alive) {
 		elapsedSinceLastAnim += elapsed;
@@ -146,69 +87,45 @@ void Entity::Update(float elapsed) {
 	}
 }
 
-void Entity::Draw(ShaderProgram &program) {
+void Entity::Draw(SpriteBatch &batch) {
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 	modelMatrix = glm::translate(modelMatrix, position);
 	modelMatrix = glm::scale(modelMatrix, size);
 
-	program.SetModelMatrix(modelMatrix);
-	sprite.Draw(program);
+	batch.Add(sprite, modelMatrix);
 }
 
-GLuint LoadTextureNearest(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		std::cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+float lastFrameTicks = 0.0f;
 
-	stbi_image_free(image);
-	return retTexture;
-}
+TextureCache textures;
+TextureHandle fontTexture, frogTexture, boyTexture, beeTexture;
 
-GLuint LoadTextureLinear(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
+#define MAX_BOYS 49
+ObjectPool<Entity> boys(MAX_BOYS);
 
-	if (image == NULL) {
-		std::cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
+#define MAX_BEES 25
+ObjectPool<Entity> bees(MAX_BEES);
 
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+Entity frog;
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+//about one boy wide, so a bee only ever overlaps a handful of cells
+#define COLLISION_CELL_SIZE 0.4f
+SpatialHash boyGrid(COLLISION_CELL_SIZE);
+std::vector<int> collisionCandidates;
 
-	stbi_image_free(image);
-	return retTexture;
+void InsertEntity(SpatialHash &grid, int index, Entity &entity) {
+	float minX, minY, maxX, maxY;
+	entity.GetBounds(&minX, &minY, &maxX, &maxY);
+	grid.Insert(index, minX, minY, maxX, maxY);
 }
 
-float lastFrameTicks = 0.0f;
-
-GLuint fontTexture, frogTexture, boyTexture, beeTexture;
-
-#define MAX_BOYS 49
-Entity boys[MAX_BOYS];
+void QueryEntity(SpatialHash &grid, Entity &entity, std::vector<int> &candidates) {
+	float minX, minY, maxX, maxY;
+	entity.GetBounds(&minX, &minY, &maxX, &maxY);
+	grid.Query(minX, minY, maxX, maxY, candidates);
+}
 
-#define MAX_BEES 25
-int beeIndex = 0;
-Entity bees[MAX_BEES];
-
-Entity frog;
+SpriteBatch spriteBatch;
 
 glm::mat4 projectionMatrix = glm::mat4(1.0f);
 glm::mat4 viewMatrix = glm::mat4(1.0f);
@@ -221,25 +138,27 @@ GameMode mode;
 void SetupGame() {
 	//Setup the Enemies
 	for (int i = 0; i < MAX_BOYS; i++) {
-		boys[i].velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		boys[i].animFPS = 8.0f;
-		boys[i].elapsedSinceLastAnim = 0.0f;
-		boys[i].alive = false;
-		boys[i].sprite = SheetSprite(boyTexture, 0.25f, 0.25f, 0.4f);
-		boys[i].size = glm::vec3(1.0f, 1.0f, 1.0f);
-		boys[i].sprite.indices.clear();
-		boys[i].sprite.indices.insert(boys[i].sprite.indices.end(), { 0.0f, 0.0f, 0.0f, 0.25f, 0.0f, 0.5f, 0.0f, 0.75f });
+		Entity &boy = boys.Slot(i);
+		boy.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+		boy.animFPS = 8.0f;
+		boy.elapsedSinceLastAnim = 0.0f;
+		boy.alive = false;
+		boy.sprite = SheetSprite(boyTexture.textureID, 0.25f, 0.25f, 0.4f);
+		boy.size = glm::vec3(1.0f, 1.0f, 1.0f);
+		boy.sprite.indices.clear();
+		boy.sprite.indices.insert(boy.sprite.indices.end(), { 0.0f, 0.0f, 0.0f, 0.25f, 0.0f, 0.5f, 0.0f, 0.75f });
 	}
 
 	//Setup the Bullets
 	for (int i = 0; i < MAX_BEES; i++) {
-		bees[i].velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		bees[i].animFPS = 1.0f;
-		bees[i].elapsedSinceLastAnim = 0.0f;
-		bees[i].alive = false;
-		bees[i].sprite = SheetSprite(beeTexture, 1.0f, 1.0f, 0.1f);
-		bees[i].size = glm::vec3(56.0f / 48.0f, 1.0f, 1.0f);
-		bees[i].sprite.indices.insert(bees[i].sprite.indices.end(), { 0.0f, 0.0f });
+		Entity &bee = bees.Slot(i);
+		bee.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+		bee.animFPS = 1.0f;
+		bee.elapsedSinceLastAnim = 0.0f;
+		bee.alive = false;
+		bee.sprite = SheetSprite(beeTexture.textureID, 1.0f, 1.0f, 0.1f);
+		bee.size = glm::vec3(56.0f / 48.0f, 1.0f, 1.0f);
+		bee.sprite.indices.insert(bee.sprite.indices.end(), { 0.0f, 0.0f });
 	}
 
 	//Setup the player
@@ -247,36 +166,33 @@ void SetupGame() {
 	frog.animFPS = 1.0f;
 	frog.elapsedSinceLastAnim = 0.0f;
 	frog.alive = false;
-	frog.sprite = SheetSprite(frogTexture, 1.0f, 1.0f, 0.33f);
+	frog.sprite = SheetSprite(frogTexture.textureID, 1.0f, 1.0f, 0.33f);
 	frog.size = glm::vec3(58.0f / 39.0f, 1.0f, 1.0f);
 	frog.sprite.indices.insert(frog.sprite.indices.end(), { 0.0f, 0.0f });
 }
 
 void NewGame() {
 	glm::vec3 currPos = glm::vec3(-0.8f, 1.8f, 0.0f);
+	boys.Clear();
+	bees.Clear();
 	for (int i = 0; i < MAX_BOYS; i++) {
-		boys[i].alive = true;
-		boys[i].position = currPos;
+		Entity *boy = boys.Acquire();
+		boy->alive = true;
+		boy->position = currPos;
 		currPos[0] += 0.266666f;
 		if ((i + 1) % 7 == 0) {
 			currPos[0] = -0.8f;
 			currPos[1] -= 0.25f;
 		}
-		boys[i].velocity[1] = -0.1f;
+		boy->velocity[1] = -0.1f;
 	}
 	frog.alive = true;
 	frog.position = glm::vec3(0.0f, -1.8, 0.0f);
 }
 
 void GameOver() {
-	for (int i = 0; i < MAX_BOYS; i++) {
-		boys[i].alive = false;
-		boys[i].position = glm::vec3(-100.0f, 0.0f, 0.0f);
-	}
-	for (int i = 0; i < MAX_BEES; i++) {
-		bees[i].alive = false;
-		bees[i].position = glm::vec3(-100.0f, 0.0f, 0.0f);
-	}
+	boys.Clear();
+	bees.Clear();
 	frog.alive = false;
 	frog.position = glm::vec3(-100.0f, 0.0f, 0.0f);
 	mode = MODE_PRESS_START;
@@ -324,12 +240,12 @@ void DrawText(ShaderProgram &program, GLuint fontTexture, std::string text, floa
 }
 
 void ShootBee() {
-	if (!(bees[beeIndex].alive)) {
-		bees[beeIndex].alive = true;
-		bees[beeIndex].position = frog.position + glm::vec3(0.0f, 0.2f, 0.0f);
-		bees[beeIndex].velocity[1] = 0.5f;
-		beeIndex += 1;
-		if (beeIndex >= MAX_BEES) { beeIndex = 0; }
+	//only drops the shot when all MAX_BEES are already in flight
+	Entity *bee = bees.Acquire();
+	if (bee != NULL) {
+		bee->alive = true;
+		bee->position = frog.position + glm::vec3(0.0f, 0.2f, 0.0f);
+		bee->velocity[1] = 0.5f;
 	}
 }
 
@@ -355,34 +271,47 @@ void Update(float elapsed) {
 			frog.position[0] = (frog.position[0] >= 1.0f ? 1.0f : -1.0f);
 		}
 
-		//Update Bees
-		for (int i = 0; i < MAX_BEES; i++) {
-			if (bees[i].alive) {
-				for (int j = 0; j < MAX_BOYS; j++) {
-					if (bees[i].IsColliding(boys[j])) {
-						bees[i].alive = false;
-						boys[j].alive = false;
-						//break;
-					}
+		//Update Bees, only testing each against the boys that share a grid cell with it
+		//the grid is keyed by pool slot, which stays put while boys are released
+		boyGrid.Clear();
+		for (int j = 0; j < boys.Count(); j++) {
+			InsertEntity(boyGrid, boys.LiveSlot(j), boys.Live(j));
+		}
+		boyGrid.Build();
+		//walk the live lists backwards, since releasing swaps the last live object into the current place
+		for (int i = bees.Count() - 1; i >= 0; i--) {
+			Entity &bee = bees.Live(i);
+			QueryEntity(boyGrid, bee, collisionCandidates);
+			for (int c = 0; c < (int)collisionCandidates.size(); c++) {
+				Entity &boy = boys.Slot(collisionCandidates[c]);
+				if (bee.IsColliding(boy)) {
+					bee.alive = false;
+					boy.alive = false;
+					//break;
 				}
-				if (bees[i].position[1] > 2.1f) { bees[i].alive = false; }
 			}
-			bees[i].Update(elapsed);
+			if (bee.position[1] > 2.1f) { bee.alive = false; }
+			if (!bee.alive) {
+				bees.Release(bees.LiveSlot(i));
+				continue;
+			}
+			bee.Update(elapsed);
 		}
 
-		//Update Boys
-		bool frogVictory = true;
-		for (int i = 0; i < MAX_BOYS; i++) {
-			if (boys[i].alive) {
-				frogVictory = false;
-				if (boys[i].position[1] < -1.6f) {
-					GameOver();
-					break;
-				}
+		//Update Boys, releasing the ones hit this step
+		for (int i = boys.Count() - 1; i >= 0; i--) {
+			Entity &boy = boys.Live(i);
+			if (!boy.alive) {
+				boys.Release(boys.LiveSlot(i));
+				continue;
+			}
+			if (boy.position[1] < -1.6f) {
+				GameOver();
+				break;
 			}
-			boys[i].Update(elapsed);
+			boy.Update(elapsed);
 		}
-		if (frogVictory) {
+		if (mode == MODE_GAME && boys.Count() == 0) {
 			GameOver();
 		}
 		break;
@@ -395,26 +324,85 @@ void Render(ShaderProgram &program) {
 		glm::mat4 modelMatrix = glm::mat4(1.0f);
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(-0.85f, 0.0f, 0.0f));
 		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "tBBF3: Modern Warfare", 0.15f, -0.075f);
+		DrawText(program, fontTexture.textureID, "tBBF3: Modern Warfare", 0.15f, -0.075f);
 		modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -0.25f, 0.0f));
 		program.SetModelMatrix(modelMatrix);
-		DrawText(program, fontTexture, "Press Space to Begin", 0.15f, -0.075f);
+		DrawText(program, fontTexture.textureID, "Press Space to Begin", 0.15f, -0.075f);
 		break;
 	case MODE_GAME:
-		for (int i = 0; i < MAX_BOYS; i++) {
-			if (boys[i].alive) { boys[i].Draw(program); }
+		spriteBatch.Begin();
+		for (int i = 0; i < boys.Count(); i++) {
+			boys.Live(i).Draw(spriteBatch);
 		}
-		for (int i = 0; i < MAX_BEES; i++) {
-			if (bees[i].alive) { bees[i].Draw(program); }
+		for (int i = 0; i < bees.Count(); i++) {
+			bees.Live(i).Draw(spriteBatch);
 		}
-		if (frog.alive) { frog.Draw(program); }
+		if (frog.alive) { frog.Draw(spriteBatch); }
+		spriteBatch.Flush(program);
 		break;
 	}
 	
 }
 
+//--bench-collision [count]: count bees against count boys scattered over a field about half covered by boys,
+//every pair tested against only the pairs the grid returns
+void BenchmarkCollision(int count) {
+	std::vector<Entity> shots(count), targets(count);
+	float fieldSize = sqrtf((float)count) * 0.6f;
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		targets[i].sprite.size = 0.4f;
+		targets[i].size = glm::vec3(1.0f, 1.0f, 1.0f);
+		targets[i].position = glm::vec3(fieldSize * rand() / RAND_MAX, fieldSize * rand() / RAND_MAX, 0.0f);
+		shots[i].sprite.size = 0.1f;
+		shots[i].size = glm::vec3(56.0f / 48.0f, 1.0f, 1.0f);
+		shots[i].position = glm::vec3(fieldSize * rand() / RAND_MAX, fieldSize * rand() / RAND_MAX, 0.0f);
+	}
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	int bruteHits = 0;
+	for (int i = 0; i < count; i++) {
+		for (int j = 0; j < count; j++) {
+			if (shots[i].IsColliding(targets[j])) { bruteHits++; }
+		}
+	}
+	double bruteTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const int steps = 100;
+	SpatialHash grid(COLLISION_CELL_SIZE);
+	std::vector<int> candidates;
+	int gridHits = 0;
+	long long candidateCount = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < steps; step++) {
+		gridHits = 0;
+		candidateCount = 0;
+		grid.Clear();
+		for (int j = 0; j < count; j++) {
+			InsertEntity(grid, j, targets[j]);
+		}
+		grid.Build();
+		for (int i = 0; i < count; i++) {
+			QueryEntity(grid, shots[i], candidates);
+			candidateCount += candidates.size();
+			for (int c = 0; c < (int)candidates.size(); c++) {
+				if (shots[i].IsColliding(targets[candidates[c]])) { gridHits++; }
+			}
+		}
+	}
+	double gridTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / steps;
+
+	std::cout << count << " x " << count << ": brute force " << bruteTime << " ms, " << bruteHits << " hits; grid "
+		<< gridTime << " ms/step, " << gridHits << " hits from " << candidateCount << " candidates\n";
+}
+
 int main(int argc, char *argv[])
 {
+	if (argc > 1 && std::string(argv[1]) == "--bench-collision") {
+		BenchmarkCollision(argc > 2 ? atoi(argv[2]) : 10000);
+		return 0;
+	}
+
     SDL_Init(SDL_INIT_VIDEO);
     displayWindow = SDL_CreateWindow("tBBF3: Modern Warfare", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 360, 720, SDL_WINDOW_OPENGL);
     SDL_GLContext context = SDL_GL_CreateContext(displayWindow);
@@ -437,10 +425,10 @@ int main(int argc, char *argv[])
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	fontTexture = LoadTextureNearest(RESOURCE_FOLDER"font_spritesheet.png");
-	frogTexture = LoadTextureNearest(RESOURCE_FOLDER"frog.png");
-	boyTexture = LoadTextureLinear(RESOURCE_FOLDER"boy_spritesheet.png");
-	beeTexture = LoadTextureNearest(RESOURCE_FOLDER"bee.png");
+	fontTexture = textures.Load(RESOURCE_FOLDER"font_spritesheet.png", TEXTURE_NEAREST);
+	frogTexture = textures.Load(RESOURCE_FOLDER"frog.png", TEXTURE_NEAREST);
+	boyTexture = textures.Load(RESOURCE_FOLDER"boy_spritesheet.png", TEXTURE_LINEAR);
+	beeTexture = textures.Load(RESOURCE_FOLDER"bee.png", TEXTURE_NEAREST);
 
 	mode = MODE_PRESS_START;
 
@@ -478,7 +466,10 @@ int main(int argc, char *argv[])
 
         SDL_GL_SwapWindow(displayWindow);
     }
+
+	spriteBatch.Cleanup();
     
+	textures.Cleanup();
     SDL_Quit();
     return 0;
 }
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifdef _WINDOWS
+	#include <GL/glew.h>
+#endif
+#include <SDL_opengl.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+enum TextureFilter { TEXTURE_NEAREST, TEXTURE_LINEAR };
+
+class TextureCache;
+
+//a counted reference to a texture in a TextureCache. the texture is deleted when its last handle goes away
+class TextureHandle {
+    public:
+		TextureHandle();
+		TextureHandle(const TextureHandle &other);
+		TextureHandle &operator=(const TextureHandle &other);
+		~TextureHandle();
+
+		void Release();
+
+		GLuint textureID;
+
+    private:
+		friend class TextureCache;
+
+		TextureCache *cache;
+		int slot;
+		unsigned int generation;
+};
+
+//loads each image file once per filter mode and shares the GL texture between every handle to it
+class TextureCache {
+    public:
+		TextureCache();
+
+		TextureHandle Load(const std::string &filePath, TextureFilter filter);
+		void Cleanup();
+		//counted from the entries themselves, so it also catches liveTextures drifting from them
+		int LiveTextures() const;
+
+		int liveTextures;
+		size_t textureBytes;
+		int decodes;
+
+    private:
+		friend class TextureHandle;
+
+		void AddReference(int slot, unsigned int generation);
+		void RemoveReference(int slot, unsigned int generation);
+
+		struct Entry {
+			std::string key;
+			GLuint textureID;
+			int references;
+			size_t bytes;
+			unsigned int generation;
+		};
+
+		std::vector<Entry> entries;
+		std::vector<int> freeSlots;
+		std::unordered_map<std::string, int> slots;
+		unsigned int nextGeneration;
+};
@@ -5,6 +5,7 @@
 #include <SDL_opengl.h>
 #include <SDL_image.h>
 #include "ShaderProgram.h"
+#include "TextureCache.h"
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #define STB_IMAGE_IMPLEMENTATION
@@ -186,51 +187,10 @@ void Entity::Draw(ShaderProgram &program) {
 	sprite.Draw(program);
 }
 
-GLuint LoadTextureNearest(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	stbi_image_free(image);
-	return retTexture;
-}
-
-GLuint LoadTextureLinear(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	stbi_image_free(image);
-	return retTexture;
-}
-
 float lastFrameTicks = 0.0f;
 
-GLuint fontTexture, coinTexture, tilesTexture, playerTexture;
+TextureCache textures;
+TextureHandle fontTexture, coinTexture, tilesTexture, playerTexture;
 
 #define FIXED_TIMESTEP 0.01666667f
 #define TILE_SIZE 0.2f
@@ -324,7 +284,7 @@ void placeEntity(string type, float placeX, float placeY) {
 		Player.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
 		Player.animFPS = 1.0f;
 		Player.elapsedSinceLastAnim = 0.0f;
-		Player.sprite = SheetSprite(playerTexture, 0.5f, 0.5f, 1.0f);
+		Player.sprite = SheetSprite(playerTexture.textureID, 0.5f, 0.5f, 1.0f);
 		Player.size = glm::vec3(0.165714f, 0.111429f, 1.0f);
 		Player.sprite.indices.insert(Player.sprite.indices.end(), {
 			0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
@@ -342,7 +302,7 @@ void placeEntity(string type, float placeX, float placeY) {
 		newCoin.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
 		newCoin.animFPS = 1.0f;
 		newCoin.elapsedSinceLastAnim = 0.0f;
-		newCoin.sprite = SheetSprite(coinTexture, 1.0f, 1.0f, 1.0f);
+		newCoin.sprite = SheetSprite(coinTexture.textureID, 1.0f, 1.0f, 1.0f);
 		newCoin.size = glm::vec3(0.1f, 0.1444f, 1.0f);
 		newCoin.sprite.indices.insert(newCoin.sprite.indices.end(), { 0.0f, 0.0f });
 		coins.push_back(newCoin);
@@ -632,7 +592,7 @@ void Update(float elapsed) {
 
 void Render(ShaderProgram &program) {
 	//draw level
-	glBindTexture(GL_TEXTURE_2D, tilesTexture);
+	glBindTexture(GL_TEXTURE_2D, tilesTexture.textureID);
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 	program.SetModelMatrix(modelMatrix);
 
@@ -690,10 +650,10 @@ int main(int argc, char *argv[])
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	fontTexture = LoadTextureNearest(RESOURCE_FOLDER"font_spritesheet.png");
-	playerTexture = LoadTextureNearest(RESOURCE_FOLDER"frog.png");
-	coinTexture = LoadTextureNearest(RESOURCE_FOLDER"coinGold.png");
-	tilesTexture = LoadTextureNearest(RESOURCE_FOLDER"tiles_spritesheet.png");
+	fontTexture = textures.Load(RESOURCE_FOLDER"font_spritesheet.png", TEXTURE_NEAREST);
+	playerTexture = textures.Load(RESOURCE_FOLDER"frog.png", TEXTURE_NEAREST);
+	coinTexture = textures.Load(RESOURCE_FOLDER"coinGold.png", TEXTURE_NEAREST);
+	tilesTexture = textures.Load(RESOURCE_FOLDER"tiles_spritesheet.png", TEXTURE_NEAREST);
 	
 	float acc = 0.0f;
 
@@ -732,6 +692,7 @@ int main(int argc, char *argv[])
         SDL_GL_SwapWindow(displayWindow);
     }
     
+	textures.Cleanup();
     SDL_Quit();
     return 0;
 }
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+//a counted-out reference to a pool slot; it goes stale once that slot is released, even if the slot is reused
+struct PoolHandle {
+	int slot;
+	unsigned int generation;
+};
+
+//fixed-capacity pool. every object is constructed up front and reused, Acquire and Release are O(1) through a
+//free list, and the live objects are kept in a dense list so iteration never visits a dead slot. releasing
+//swaps the last live object into the released one's place, so iterate the live list from the back when
+//releasing as you go
+template <typename T>
+class ObjectPool {
+    public:
+		ObjectPool(int capacity_in);
+
+		T *Acquire(PoolHandle *handle = NULL);
+		void Release(int slot);
+		void Release(PoolHandle handle);
+		void Clear();
+
+		//the i-th live object and the slot it occupies, for 0 <= i < Count()
+		int Count() const;
+		T &Live(int i);
+		const T &Live(int i) const;
+		int LiveSlot(int i) const;
+
+		//any slot, live or not, for setting up the objects once before play
+		T &Slot(int slot);
+
+		PoolHandle Handle(int slot) const;
+		T *Get(PoolHandle handle);
+
+		int capacity;
+
+    private:
+		std::vector<T> objects;
+		std::vector<int> freeSlots;
+		std::vector<int> liveSlots;
+		std::vector<int> livePosition;
+		std::vector<unsigned int> generations;
+};
+
+template <typename T>
+ObjectPool<T>::ObjectPool(int capacity_in) : objects(capacity_in) {
+	capacity = capacity_in;
+	livePosition.assign(capacity, -1);
+	generations.assign(capacity, 1);
+	liveSlots.reserve(capacity);
+	freeSlots.reserve(capacity);
+	//hand out the lowest slots first
+	for (int slot = capacity - 1; slot >= 0; slot--) {
+		freeSlots.push_back(slot);
+	}
+}
+
+//returns NULL when every slot is live. the object keeps whatever state it was released with
+template <typename T>
+T *ObjectPool<T>::Acquire(PoolHandle *handle) {
+	if (freeSlots.empty()) { return NULL; }
+	int slot = freeSlots.back();
+	freeSlots.pop_back();
+	livePosition[slot] = (int)liveSlots.size();
+	liveSlots.push_back(slot);
+	if (handle != NULL) { *handle = Handle(slot); }
+	return &objects[slot];
+}
+
+template <typename T>
+void ObjectPool<T>::Release(int slot) {
+	int position = livePosition[slot];
+	if (position == -1) { return; }
+	int lastSlot = liveSlots.back();
+	liveSlots[position] = lastSlot;
+	livePosition[lastSlot] = position;
+	liveSlots.pop_back();
+	livePosition[slot] = -1;
+	generations[slot]++;
+	freeSlots.push_back(slot);
+}
+
+template <typename T>
+void ObjectPool<T>::Release(PoolHandle handle) {
+	if (Get(handle) != NULL) { Release(handle.slot); }
+}
+
+template <typename T>
+void ObjectPool<T>::Clear() {
+	while (!liveSlots.empty()) {
+		Release(liveSlots.back());
+	}
+}
+
+template <typename T>
+int ObjectPool<T>::Count() const {
+	return (int)liveSlots.size();
+}
+
+template <typename T>
+T &ObjectPool<T>::Live(int i) {
+	return objects[liveSlots[i]];
+}
+
+template <typename T>
+const T &ObjectPool<T>::Live(int i) const {
+	return objects[liveSlots[i]];
+}
+
+template <typename T>
+int ObjectPool<T>::LiveSlot(int i) const {
+	return liveSlots[i];
+}
+
+template <typename T>
+T &ObjectPool<T>::Slot(int slot) {
+	return objects[slot];
+}
+
+template <typename T>
+PoolHandle ObjectPool<T>::Handle(int slot) const {
+	PoolHandle handle;
+	handle.slot = slot;
+	handle.generation = generations[slot];
+	return handle;
+}
+
+//NULL if the handle's slot has been released since the handle was made
+template <typename T>
+T *ObjectPool<T>::Get(PoolHandle handle) {
+	if (handle.slot < 0 || handle.slot >= capacity) { return NULL; }
+	if (livePosition[handle.slot] == -1 || generations[handle.slot] != handle.generation) { return NULL; }
+	return &objects[handle.slot];
+}
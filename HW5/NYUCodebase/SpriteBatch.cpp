@@ -0,0 +1,117 @@
+#include "SpriteBatch.h"
+#include <algorithm>
+
+SheetSprite::SheetSprite() {
+	size = 1.0f;
+	textureID = 0;
+	u = 1.0f;
+	v = 1.0f;
+	width = 1.0f;
+	height = 1.0f;
+}
+
+SheetSprite::SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in) {
+	size = size_in;
+	textureID = textureID_in;
+	u = 0.0f;
+	v = 0.0f;
+	currAnimFrame = 0;
+	width = width_in;
+	height = height_in;
+}
+
+void SheetSprite::Animate() {
+	u = indices[currAnimFrame];
+	v = indices[currAnimFrame + 1];
+	
+	currAnimFrame += 2;
+	if (currAnimFrame >= indices.size()) { currAnimFrame = 0; }
+}
+
+SpriteBatch::SpriteBatch() {
+	bufferID = 0;
+	drawCalls = 0;
+}
+
+void SpriteBatch::Begin() {
+	quads.clear();
+	quadVertices.clear();
+	drawCalls = 0;
+}
+
+void SpriteBatch::Add(const SheetSprite &sprite, const glm::mat4 &modelMatrix) {
+	float half = 0.5f * sprite.size;
+	float corners[] = {
+		-half, -half, sprite.u, sprite.v + sprite.height,
+		half, half, sprite.u + sprite.width, sprite.v,
+		-half, half, sprite.u, sprite.v,
+		half, half, sprite.u + sprite.width, sprite.v,
+		-half, -half, sprite.u, sprite.v + sprite.height,
+		half, -half, sprite.u + sprite.width, sprite.v + sprite.height
+	};
+
+	BatchedQuad quad;
+	quad.textureID = sprite.textureID;
+	quad.order = (int)quads.size();
+	quads.push_back(quad);
+
+	//sprites are flat, so only the 2D part of the model matrix matters
+	for (int i = 0; i < 6; i++) {
+		float x = corners[i * 4];
+		float y = corners[i * 4 + 1];
+		quadVertices.push_back(modelMatrix[0][0] * x + modelMatrix[1][0] * y + modelMatrix[3][0]);
+		quadVertices.push_back(modelMatrix[0][1] * x + modelMatrix[1][1] * y + modelMatrix[3][1]);
+		quadVertices.push_back(corners[i * 4 + 2]);
+		quadVertices.push_back(corners[i * 4 + 3]);
+	}
+}
+
+//sorting groups quads by texture, so overlapping sprites from different textures
+//are only layered correctly relative to each other across separate Flush calls
+void SpriteBatch::Flush(ShaderProgram &program) {
+	if (quads.empty()) { return; }
+
+	std::stable_sort(quads.begin(), quads.end(), [](const BatchedQuad &a, const BatchedQuad &b) {
+		return a.textureID < b.textureID;
+	});
+
+	sortedVertices.clear();
+	for (int i = 0; i < (int)quads.size(); i++) {
+		const float *src = &quadVertices[quads[i].order * 24];
+		sortedVertices.insert(sortedVertices.end(), src, src + 24);
+	}
+
+	if (bufferID == 0) { glGenBuffers(1, &bufferID); }
+	glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+	glBufferData(GL_ARRAY_BUFFER, sortedVertices.size() * sizeof(float), sortedVertices.data(), GL_STREAM_DRAW);
+
+	program.SetModelMatrix(glm::mat4(1.0f));
+	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(program.positionAttribute);
+	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(program.texCoordAttribute);
+
+	int runStart = 0;
+	for (int i = 1; i <= (int)quads.size(); i++) {
+		if (i == (int)quads.size() || quads[i].textureID != quads[runStart].textureID) {
+			glBindTexture(GL_TEXTURE_2D, quads[runStart].textureID);
+			glDrawArrays(GL_TRIANGLES, runStart * 6, (i - runStart) * 6);
+			drawCalls++;
+			runStart = i;
+		}
+	}
+
+	glDisableVertexAttribArray(program.positionAttribute);
+	glDisableVertexAttribArray(program.texCoordAttribute);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	quads.clear();
+	quadVertices.clear();
+}
+
+void SpriteBatch::Cleanup() {
+	if (bufferID != 0) {
+		glDeleteBuffers(1, &bufferID);
+		bufferID = 0;
+	}
+}
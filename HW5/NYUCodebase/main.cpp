@@ -5,6 +5,10 @@
 #include <SDL_opengl.h>
 #include <SDL_image.h>
 #include "ShaderProgram.h"
+#include "TextureCache.h"
+#include "SpatialHash.h"
+#include "SpriteBatch.h"
+#include "ObjectPool.h"
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #define STB_IMAGE_IMPLEMENTATION
@@ -12,6 +16,7 @@
 #include <SDL_mixer.h>
 #include <ctime>
 #include <vector>
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <iostream>
@@ -28,36 +33,18 @@ using namespace std;
 SDL_Window* displayWindow;
 
 
-class SheetSprite {
-	public:
-		SheetSprite();
-		SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in);
-
-		void Draw(ShaderProgram &program);
-
-		float size;
-		GLuint textureID;
-		vector<float> indices;
-		unsigned int currAnimFrame;
-		float u;
-		float v;
-		float width;
-		float height;
-
-		void Animate();
-};
-
 enum EntityType {ENTITY_PLAYER, ENTITY_COIN};
 
 class Entity {
 	public:
 
-		void Draw(ShaderProgram &program);
+		void Draw(SpriteBatch &batch);
 		void Animate(float elapsed);
 		void UpdateX(float elapsed);
 		void UpdateY(float elapsed);
 
 		bool IsColliding(Entity &entity);
+		void GetBounds(float *minX, float *minY, float *maxX, float *maxY);
 
 		glm::vec3 position;
 		glm::vec3 velocity;
@@ -81,65 +68,6 @@ class Entity {
 		bool collidedRight;
 };
 
-SheetSprite::SheetSprite() {
-	size = 1.0f;
-	textureID = 0;
-	u = 1.0f;
-	v = 1.0f;
-	width = 1.0f;
-	height = 1.0f;
-}
-
-SheetSprite::SheetSprite(GLuint textureID_in, float width_in, float height_in, float size_in) {
-	size = size_in;
-	textureID = textureID_in;
-	u = 0.0f;
-	v = 0.0f;
-	currAnimFrame = 0;
-	width = width_in;
-	height = height_in;
-}
-
-void SheetSprite::Draw(ShaderProgram &program) {
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	GLfloat texCoords[] = {
-		u, v + height,
-		u + width, v,
-		u, v,
-		u + width, v,
-		u, v + height,
-		u + width, v + height
-	};
-
-	float vertices[] = {
-		-0.5f * size, -0.5f * size,
-		0.5f * size, 0.5f * size,
-		-0.5f * size, 0.5f * size,
-		0.5f * size, 0.5f * size,
-		-0.5f * size, -0.5f * size,
-		0.5f * size, -0.5f * size,
-	};
-
-	glVertexAttribPointer(program.positionAttribute, 2, GL_FLOAT, false, 0, vertices);
-	glEnableVertexAttribArray(program.positionAttribute);
-
-	glVertexAttribPointer(program.texCoordAttribute, 2, GL_FLOAT, false, 0, texCoords);
-	glEnableVertexAttribArray(program.texCoordAttribute);
-
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisableVertexAttribArray(program.positionAttribute);
-	glDisableVertexAttribArray(program.texCoordAttribute);
-}
-
-void SheetSprite::Animate() {
-	u = indices[currAnimFrame];
-	v = indices[currAnimFrame + 1];
-	
-	currAnimFrame += 2;
-	if (currAnimFrame >= indices.size()) { currAnimFrame = 0; }
-}
-
 bool Entity::IsColliding(Entity &entity) {
 	float e1HalfWidth = (sprite.size * size[0]) / 2.0f;
 	float e1HalfHeight = (sprite.size * size[1]) / 2.0f;
@@ -150,6 +78,16 @@ bool Entity::IsColliding(Entity &entity) {
 	return (xOverlap && yOverlap);
 }
 
+//the box IsColliding tests against
+void Entity::GetBounds(float *minX, float *minY, float *maxX, float *maxY) {
+	float halfWidth = (sprite.size * size[0]) / 2.0f;
+	float halfHeight = (sprite.size * size[1]) / 2.0f;
+	*minX = position[0] - halfWidth;
+	*minY = position[1] - halfHeight;
+	*maxX = position[0] + halfWidth;
+	*maxY = position[1] + halfHeight;
+}
+
 float lerp(float v0, float v1, float t) {
 	return (float)((1.0 - t)*v0 + t * v1);
 }
@@ -178,60 +116,18 @@ void Entity::UpdateY(float elapsed) {
 	}
 }
 
-void Entity::Draw(ShaderProgram &program) {
+void Entity::Draw(SpriteBatch &batch) {
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 	modelMatrix = glm::translate(modelMatrix, position);
 	modelMatrix = glm::scale(modelMatrix, size);
 
-	program.SetModelMatrix(modelMatrix);
-	sprite.Draw(program);
-}
-
-GLuint LoadTextureNearest(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	stbi_image_free(image);
-	return retTexture;
-}
-
-GLuint LoadTextureLinear(const char *filePath) {
-	int w, h, comp;
-	unsigned char* image = stbi_load(filePath, &w, &h, &comp, STBI_rgb_alpha);
-
-	if (image == NULL) {
-		cout << "Unable to load image. Make sure the path is correct\n";
-		assert(false);
-	}
-
-	GLuint retTexture;
-	glGenTextures(1, &retTexture);
-	glBindTexture(GL_TEXTURE_2D, retTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	stbi_image_free(image);
-	return retTexture;
+	batch.Add(sprite, modelMatrix);
 }
 
 float lastFrameTicks = 0.0f;
 
-GLuint fontTexture, coinTexture, tilesTexture, playerTexture;
+TextureCache textures;
+TextureHandle fontTexture, coinTexture, tilesTexture, playerTexture;
 
 Mix_Chunk *pickup, *jump;
 Mix_Music *bgm;
@@ -247,7 +143,13 @@ Mix_Music *bgm;
 vector<float> level1_vertexData;
 vector<float> level1_texCoordData;
 
-vector<Entity> coins;
+//the level has 17; extra coins in the map are skipped
+#define MAX_COINS 64
+ObjectPool<Entity> coins(MAX_COINS);
+SpatialHash coinGrid(TILE_SIZE);
+vector<int> collisionCandidates;
+
+SpriteBatch spriteBatch;
 Entity Player;
 
 int mapWidth, mapHeight;
@@ -328,7 +230,7 @@ void placeEntity(string type, float placeX, float placeY) {
 		Player.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
 		Player.animFPS = 1.0f;
 		Player.elapsedSinceLastAnim = 0.0f;
-		Player.sprite = SheetSprite(playerTexture, 0.5f, 0.5f, 1.0f);
+		Player.sprite = SheetSprite(playerTexture.textureID, 0.5f, 0.5f, 1.0f);
 		Player.size = glm::vec3(0.165714f, 0.111429f, 1.0f);
 		Player.sprite.indices.insert(Player.sprite.indices.end(), {
 			0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f,
@@ -339,17 +241,23 @@ void placeEntity(string type, float placeX, float placeY) {
 		Player.animFPS = 4.0f;
 	}
 	else if (type == "coin") {
-		Entity newCoin;
+		Entity *coin = coins.Acquire();
+		if (coin == NULL) {
+			cout << "More than " << MAX_COINS << " coins in the map\n";
+			return;
+		}
+		Entity &newCoin = *coin;
 		newCoin.entityType = ENTITY_COIN;
 		newCoin.position = glm::vec3(placeX + 0.5f * TILE_SIZE, placeY, 0.0f);
 		newCoin.isStatic = false;
 		newCoin.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+		newCoin.acceleration = glm::vec3(0.0f, 0.0f, 0.0f);
+		newCoin.collidedTop = newCoin.collidedBottom = newCoin.collidedLeft = newCoin.collidedRight = false;
 		newCoin.animFPS = 1.0f;
 		newCoin.elapsedSinceLastAnim = 0.0f;
-		newCoin.sprite = SheetSprite(coinTexture, 1.0f, 1.0f, 1.0f);
+		newCoin.sprite = SheetSprite(coinTexture.textureID, 1.0f, 1.0f, 1.0f);
 		newCoin.size = glm::vec3(0.1f, 0.1444f, 1.0f);
-		newCoin.sprite.indices.insert(newCoin.sprite.indices.end(), { 0.0f, 0.0f });
-		coins.push_back(newCoin);
+		newCoin.sprite.indices.assign({ 0.0f, 0.0f });
 	}
 }
 
@@ -613,35 +521,48 @@ void Update(float elapsed) {
 	Player.UpdateX(elapsed);
 	HandleTilemapCollisionX(Player);
 
-	//Update Coins
-	for (int i = 0; i < (int)coins.size(); i++) {
-		if (coins[i].IsColliding(Player)) {
+	//Update Coins, only testing the player against coins that share a tile with it
+	float minX, minY, maxX, maxY;
+	coinGrid.Clear();
+	for (int i = 0; i < coins.Count(); i++) {
+		coins.Live(i).GetBounds(&minX, &minY, &maxX, &maxY);
+		coinGrid.Insert(coins.LiveSlot(i), minX, minY, maxX, maxY);
+	}
+	coinGrid.Build();
+	Player.GetBounds(&minX, &minY, &maxX, &maxY);
+	coinGrid.Query(minX, minY, maxX, maxY, collisionCandidates);
+
+	//the grid is keyed by pool slot, which stays valid as coins are released
+	for (int c = 0; c < (int)collisionCandidates.size(); c++) {
+		int slot = collisionCandidates[c];
+		if (coins.Slot(slot).IsColliding(Player)) {
 			Mix_PlayChannel(-1, pickup, 0);
-			coins.erase(coins.begin() + i);
+			coins.Release(slot);
 		}
 	}
 
-	for (int i = 0; i < (int)coins.size(); i++) {
+	for (int i = 0; i < coins.Count(); i++) {
+		Entity &coin = coins.Live(i);
 		//every frame
-		coins[i].acceleration = glm::vec3(0.0f, 0.0f, 0.0f);
+		coin.acceleration = glm::vec3(0.0f, 0.0f, 0.0f);
 
 		//gravity
-		if (!coins[i].collidedBottom) {
-			coins[i].acceleration[1] += -0.7f;
+		if (!coin.collidedBottom) {
+			coin.acceleration[1] += -0.7f;
 		}
 		//do work on y-axis
-		coins[i].UpdateY(elapsed);
-		HandleTilemapCollisionY(coins[i]);
+		coin.UpdateY(elapsed);
+		HandleTilemapCollisionY(coin);
 
 		//x-axis
-		coins[i].UpdateX(elapsed);
-		HandleTilemapCollisionX(coins[i]);
+		coin.UpdateX(elapsed);
+		HandleTilemapCollisionX(coin);
 	}
 }
 
 void Render(ShaderProgram &program) {
 	//draw level
-	glBindTexture(GL_TEXTURE_2D, tilesTexture);
+	glBindTexture(GL_TEXTURE_2D, tilesTexture.textureID);
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 	program.SetModelMatrix(modelMatrix);
 
@@ -656,14 +577,17 @@ void Render(ShaderProgram &program) {
 	glDisableVertexAttribArray(program.texCoordAttribute);
 
 	//draw entities
+	spriteBatch.Begin();
 
 	//player
-	Player.Draw(program);
+	Player.Draw(spriteBatch);
 
 	//coins
-	for (int i = 0; i < (int)coins.size(); i++) {
-		coins[i].Draw(program);
+	for (int i = 0; i < coins.Count(); i++) {
+		coins.Live(i).Draw(spriteBatch);
 	}
+
+	spriteBatch.Flush(program);
 }
 
 glm::vec3 getCameraPos(){
@@ -701,10 +625,10 @@ int main(int argc, char *argv[])
 
 	Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 4096);
 
-	fontTexture = LoadTextureNearest(RESOURCE_FOLDER"font_spritesheet.png");
-	playerTexture = LoadTextureNearest(RESOURCE_FOLDER"frog.png");
-	coinTexture = LoadTextureNearest(RESOURCE_FOLDER"coinGold.png");
-	tilesTexture = LoadTextureNearest(RESOURCE_FOLDER"tiles_spritesheet.png");
+	fontTexture = textures.Load(RESOURCE_FOLDER"font_spritesheet.png", TEXTURE_NEAREST);
+	playerTexture = textures.Load(RESOURCE_FOLDER"frog.png", TEXTURE_NEAREST);
+	coinTexture = textures.Load(RESOURCE_FOLDER"coinGold.png", TEXTURE_NEAREST);
+	tilesTexture = textures.Load(RESOURCE_FOLDER"tiles_spritesheet.png", TEXTURE_NEAREST);
 
 	pickup = Mix_LoadWAV(RESOURCE_FOLDER"coinPickup.wav");
 	jump = Mix_LoadWAV(RESOURCE_FOLDER"jump.wav");
@@ -750,7 +674,10 @@ int main(int argc, char *argv[])
 	Mix_FreeChunk(jump);
 	Mix_FreeChunk(pickup);
 	Mix_FreeMusic(bgm);
+
+	spriteBatch.Cleanup();
     
+	textures.Cleanup();
     SDL_Quit();
     return 0;
 }